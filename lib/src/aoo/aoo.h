@@ -17,13 +17,20 @@ typedef AOO_SAMPLETYPE aoo_sample;
 #define AOO_DEFPACKETSIZE 512 // ?
 #define AOO_DOMAIN "/AoO"
 #define AOO_FORMAT "/format"
-#define AOO_FORMAT_NARGS 7
+#define AOO_FORMAT_NARGS 7 // + optional flags
 #define AOO_FORMAT_WILDCARD "/AoO/*/format"
 #define AOO_DATA "/data"
-#define AOO_DATA_NARGS 9
+#define AOO_DATA_NARGS 10 // 9 without <time> (older sources)
 #define AOO_DATA_WILDCARD "/AoO/*/data"
 #define AOO_REQUEST "/request"
 #define AOO_RESEND "/resend"
+#define AOO_PING "/ping"
+#define AOO_PING_WILDCARD "/AoO/*/ping"
+#define AOO_PONG "/pong"
+
+// flags for /format and /request messages:
+// the source offers, resp. the sink accepts binary /data messages
+#define AOO_FLAG_BINDATA 0x01
 
 #ifndef AOO_CLIP_OUTPUT
 #define AOO_CLIP_OUTPUT 0
@@ -54,6 +61,8 @@ typedef AOO_SAMPLETYPE aoo_sample;
 #define AOO_RESEND_MAXNUMFRAMES 64
 #define AOO_RESEND_PACKETSIZE 256
 
+#define AOO_PING_INTERVAL 1000
+
 void aoo_setup(void);
 void aoo_close(void);
 
@@ -67,6 +76,24 @@ void aoo_close(void);
 
 int32_t aoo_parsepattern(const char *msg, int32_t n, int32_t *id);
 
+typedef enum aoo_msgtype
+{
+    AOO_MSG_NONE = 0, // not an AoO message
+    AOO_MSG_UNKNOWN, // AoO message with unknown type
+    AOO_MSG_FORMAT,
+    AOO_MSG_DATA,
+    AOO_MSG_REQUEST,
+    AOO_MSG_RESEND,
+    AOO_MSG_PING,
+    AOO_MSG_PONG
+} aoo_msgtype;
+
+// parse the address pattern and the message type in a single pass.
+// also accepts binary /data messages.
+// id: the source or sink ID
+// returns: the message type
+aoo_msgtype aoo_parsemessage(const char *msg, int32_t n, int32_t *id);
+
 uint64_t aoo_osctime_get(void);
 
 double aoo_osctime_toseconds(uint64_t t);
@@ -81,6 +108,55 @@ typedef void (*aoo_replyfn)(
         int32_t         // number of bytes
 );
 
+// network statistics of a peer, measured with /ping and /pong messages
+typedef struct aoo_peer_info
+{
+    double rtt;     // smoothed round trip time in seconds
+    double jitter;  // round trip time variation in seconds
+    double offset;  // clock offset (peer - local) in seconds
+    double arrival_jitter; // interarrival jitter (RFC 3550) in seconds, only for sources
+} aoo_peer_info;
+
+/*//////////////////// Stream transport ///////////////*/
+
+// AoO messages can also be sent over reliable stream transports (e.g. TCP).
+// Streams don't preserve message boundaries, so every message must be framed.
+// Sinks should enable the 'reliable' setting to skip the resend machinery.
+
+typedef enum aoo_framing
+{
+    AOO_FRAMING_SLIP = 0, // OSC 1.1: double ended SLIP (RFC 1055)
+    AOO_FRAMING_SIZE // OSC 1.0: int32 size prefix (big endian)
+} aoo_framing;
+
+// frame a message for a stream transport, e.g. in a aoo_replyfn.
+// SLIP needs at most 2 * n + 2 bytes, the size prefix n + 4 bytes.
+// returns the number of bytes written or 0 if the buffer is too small
+int32_t aoo_stream_frame(aoo_framing framing, const char *msg, int32_t n,
+                         char *buf, int32_t size);
+
+typedef struct aoo_stream_reader aoo_stream_reader;
+
+typedef void (*aoo_messagefn)(
+        void *,         // user data
+        const char *,   // message
+        int32_t         // number of bytes
+);
+
+aoo_stream_reader * aoo_stream_reader_new(aoo_framing framing);
+
+void aoo_stream_reader_free(aoo_stream_reader *reader);
+
+// discard partially received messages, e.g. after reconnecting
+void aoo_stream_reader_reset(aoo_stream_reader *reader);
+
+// feed bytes received from the stream and call 'fn' for every complete
+// message, e.g. to pass it to aoo_sink_handlemessage().
+// returns the number of messages or -1 if the stream is corrupted
+// (only with AOO_FRAMING_SIZE; SLIP resynchronizes on the next frame).
+int32_t aoo_stream_reader_feed(aoo_stream_reader *reader, const char *data, int32_t n,
+                               void *user, aoo_messagefn fn);
+
 /*//////////////////// AoO source /////////////////////*/
 
 #define AOO_SOURCE_DEFBUFSIZE 10
@@ -109,6 +185,13 @@ typedef struct aoo_source_settings
     int32_t buffersize;
     int32_t packetsize;
     int32_t resend_buffersize;
+    int32_t ping_interval;
+    // coalesce outgoing messages into OSC bundles of up to 'packetsize' bytes.
+    // pending messages are sent when aoo_source_send() returns 0.
+    int32_t bundle;
+    // offer compact binary /data messages; sinks which don't support them
+    // keep receiving OSC messages.
+    int32_t binary;
     double time_filter_bandwidth;
 } aoo_source_settings;
 
@@ -131,6 +214,9 @@ void aoo_source_removeall(aoo_source *src);
 
 void aoo_source_setsinkchannel(aoo_source *src, void *sink, int32_t id, int32_t chn);
 
+// returns 1 if the info is available, otherwise 0
+int32_t aoo_source_getsinkinfo(aoo_source *src, void *sink, int32_t id, aoo_peer_info *info);
+
 // e.g. /request
 void aoo_source_handlemessage(aoo_source *src, const char *data, int32_t n,
                               void *sink, aoo_replyfn fn);
@@ -193,7 +279,10 @@ typedef struct aoo_sink_settings
     int32_t resend_interval;
     int32_t resend_maxnumframes;
     int32_t resend_packetsize;
+    int32_t playout_delay;
+    int32_t ping_interval;
     double time_filter_bandwidth;
+    int32_t reliable; // reliable transport, don't request dropped packets
 } aoo_sink_settings;
 
 aoo_sink * aoo_sink_new(int32_t id);
@@ -207,12 +296,28 @@ void aoo_sink_setup(aoo_sink *sink, aoo_sink_settings *settings);
 int32_t aoo_sink_handlemessage(aoo_sink *sink, const char *data, int32_t n,
                             void *src, aoo_replyfn fn);
 
+// same as above, but with the arrival time of the packet (e.g. a kernel
+// timestamp) as an OSC time tag. 0 means unknown (use the current time).
+int32_t aoo_sink_handlemessage_timed(aoo_sink *sink, const char *data, int32_t n,
+                                  void *src, aoo_replyfn fn, uint64_t t);
+
 int32_t aoo_sink_process(aoo_sink *sink, uint64_t t);
 
+// forget a source (e.g. because the endpoint has gone away);
+// AOO_ID_WILDCARD removes all sources of the endpoint.
+void aoo_sink_removesource(aoo_sink *sink, void *src, int32_t id);
+
+// returns 1 if the info is available, otherwise 0
+int32_t aoo_sink_getsourceinfo(aoo_sink *sink, void *src, int32_t id, aoo_peer_info *info);
+
 
 /*//////////////////// Codec //////////////////////////*/
 
-#define AOO_CODEC_MAXSETTINGSIZE 256
+#define AOO_CODEC_MAXSETTINGSIZE 512
+
+// codecs are identified by a unique numeric ID on the wire,
+// see AOO_CODEC_PCM_ID, AOO_CODEC_OPUS_ID, etc.
+#define AOO_CODEC_MAXNUM 16
 
 typedef void* (*aoo_codec_new)(void);
 
@@ -255,9 +360,20 @@ typedef int32_t (*aoo_codec_decode)(
 
 );
 
+// reconstruct a lost block, e.g. with forward error correction data
+// contained in the following block. the input may be NULL (= packet loss concealment).
+typedef int32_t (*aoo_codec_recover)(
+        void *,         // the decoder instance
+        const char *,   // input bytes of the following block (or NULL)
+        int32_t,        // input size
+        aoo_sample *,   // output samples (interleaved)
+        int32_t         // number of samples
+);
+
 typedef struct aoo_codec
 {
     const char *name;
+    int32_t id; // 0 <= id < AOO_CODEC_MAXNUM
     // encoder
     aoo_codec_new encoder_new;
     aoo_codec_free encoder_free;
@@ -269,6 +385,7 @@ typedef struct aoo_codec
     aoo_codec_free decoder_free;
     aoo_codec_decode decoder_decode;
     aoo_codec_readformat decoder_read;
+    aoo_codec_recover decoder_recover; // optional (may be NULL)
 } aoo_codec;
 
 typedef void (*aoo_codec_registerfn)(const char *, const aoo_codec *);
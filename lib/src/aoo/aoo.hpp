@@ -30,6 +30,8 @@ public:
 
     virtual void set_sink_channel(void *sink, int32_t id, int32_t chn);
 
+    virtual bool get_sink_info(void *sink, int32_t id, aoo_peer_info& info);
+
     virtual void handle_message(const char *data, int32_t n,
                                 void *endpoint, aoo_replyfn fn);
 
@@ -62,8 +64,16 @@ public:
     virtual int32_t handle_message(const char *data, int32_t n,
                                    void *endpoint, aoo_replyfn fn);
 
+    // t: arrival time (0 = unknown)
+    virtual int32_t handle_message(const char *data, int32_t n,
+                                   void *endpoint, aoo_replyfn fn, uint64_t t);
+
     virtual int32_t process(uint64_t t);
 
+    virtual void remove_source(void *src, int32_t id);
+
+    virtual bool get_source_info(void *src, int32_t id, aoo_peer_info& info);
+
     class deleter {
     public:
         void operator()(isink *x){
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "aoo.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*/////////////////// lossless codec ////////////////////////*/
+
+// fixed linear prediction + Rice coding on integer PCM.
+// the decoded samples are identical to the PCM codec with the same bitdepth
+// (as long as the input is within [-1, 1]; out-of-range samples are clipped).
+
+#define AOO_CODEC_LOSSLESS "lossless"
+#define AOO_CODEC_LOSSLESS_ID 2
+
+typedef struct aoo_format_lossless
+{
+    aoo_format header;
+    int32_t bitdepth; // 16 or 24
+} aoo_format_lossless;
+
+void aoo_codec_lossless_setup(aoo_codec_registerfn fn);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -2,6 +2,7 @@
 
 #include "aoo.h"
 #include "opus/include/opus.h"
+#include "opus/include/opus_multistream.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -11,6 +12,7 @@ extern "C"
 /*/////////////////// Opus codec ////////////////////////*/
 
 #define AOO_CODEC_OPUS "opus"
+#define AOO_CODEC_OPUS_ID 1
 
 typedef struct aoo_format_opus
 {
@@ -18,6 +20,12 @@ typedef struct aoo_format_opus
     int32_t bitrate; // 0: default
     int32_t complexity; // 0: default
     int32_t signal_type;
+    // the following options only affect the encoder.
+    // NOTE: in-band FEC only works in the SILK or hybrid modes,
+    // i.e. at lower bitrates and/or with the "voice" signal type.
+    int32_t fec; // in-band forward error correction (0: off, 1: on)
+    int32_t packet_loss; // expected packet loss in percent
+    int32_t dtx; // discontinuous transmission (0: off, 1: on)
 } aoo_format_opus;
 
 void aoo_codec_opus_setup(aoo_codec_registerfn fn);
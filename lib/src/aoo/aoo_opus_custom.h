@@ -0,0 +1,35 @@
+#pragma once
+
+#include "aoo.h"
+#include "opus/include/opus.h"
+#include "opus/include/opus_custom.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*/////////////////// Opus Custom codec ////////////////////////*/
+
+// low-latency Opus (CELT only) with arbitrary frame sizes, e.g. 64 or 128 samples.
+// needs libopus built with --enable-custom-modes, so it is disabled by default.
+
+#ifndef AOO_OPUS_CUSTOM
+#define AOO_OPUS_CUSTOM 0
+#endif
+
+#define AOO_CODEC_OPUS_CUSTOM "opus_custom"
+#define AOO_CODEC_OPUS_CUSTOM_ID 3
+
+typedef struct aoo_format_opus_custom
+{
+    aoo_format header;
+    int32_t bitrate; // 0: default
+    int32_t complexity; // 0 - 10
+} aoo_format_opus_custom;
+
+void aoo_codec_opus_custom_setup(aoo_codec_registerfn fn);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -235,6 +235,50 @@ fail:
     nargs_ = 0;
 }
 
+/*///////////////////////// received_bundle //////////////////////////*/
+
+// #bundle <timetag> [<size> <element>]...
+// each element is either a message or another bundle.
+
+inline received_bundle::received_bundle(const received_packet& packet)
+{
+    auto data = packet.data();
+    auto size = packet.size();
+    // "#bundle" + time tag
+    if (size < 16 || (size & 3) != 0){
+        LOG_ERROR("bad OSC bundle size!");
+        data_ = nullptr;
+        end_ = nullptr;
+        time_ = 0;
+        return;
+    }
+    time_ = from_bytes<uint64_t>(data + 8);
+    data_ = data + 16;
+    end_ = data + size;
+}
+
+inline received_packet received_bundle::iterator::operator*() const {
+    auto size = from_bytes<int32_t>(data_);
+    return received_packet(data_ + 4, size);
+}
+
+inline void received_bundle::iterator::advance(){
+    data_ += from_bytes<int32_t>(data_) + 4;
+    validate();
+}
+
+inline void received_bundle::iterator::validate(){
+    // stop at the first malformed element
+    if (data_ != end_){
+        auto avail = end_ - data_ - 4;
+        auto size = avail >= 0 ? from_bytes<int32_t>(data_) : -1;
+        if (size < 0 || (size & 3) != 0 || size > avail){
+            LOG_ERROR("bad OSC bundle element!");
+            data_ = end_;
+        }
+    }
+}
+
 /*/////////////////////// message_builder //////////////////////*/
 
 inline message_builder::message_builder(char *buffer, int32_t size)
@@ -363,8 +407,8 @@ inline void message_builder::set_args(const char *tags, int32_t n){
         invalidate();
         return;
     }
-    *tag_ = ',';
     memset(tag_ + size - 4, 0, 4); // first zero pad the last four bytes
+    *tag_ = ',';
     memcpy(tag_ + 1, tags, n); // now copy tags
     data_ = tag_ + size;
     tag_++; // skip ','
@@ -511,5 +555,177 @@ inline message_builder& message_builder::operator <<(inf_tag i){
     return *this;
 }
 
+/*/////////////////////// message_schema //////////////////////*/
+
+namespace detail {
+
+template<typename T>
+struct arg_traits; // unsupported type
+
+template<typename T, char Tag>
+struct scalar_traits {
+    static constexpr char tag = Tag;
+    static constexpr int32_t count(const T&) { return 1; }
+    static constexpr int32_t size(const T&) { return sizeof(T); }
+    static char * write_tags(char *tags, const T&){
+        *tags = Tag;
+        return tags + 1;
+    }
+    static char * write(char *data, const T& v){
+        to_bytes<T>(v, data);
+        return data + sizeof(T);
+    }
+    static const char * read(const char *data, const char *end, T& v){
+        if ((end - data) < (int32_t)sizeof(T)){
+            return nullptr;
+        }
+        v = from_bytes<T>(data);
+        return data + sizeof(T);
+    }
+};
+
+template<> struct arg_traits<int32_t> : scalar_traits<int32_t, 'i'> {};
+template<> struct arg_traits<int64_t> : scalar_traits<int64_t, 'h'> {};
+template<> struct arg_traits<float> : scalar_traits<float, 'f'> {};
+template<> struct arg_traits<double> : scalar_traits<double, 'd'> {};
+template<> struct arg_traits<timetag> : scalar_traits<timetag, 't'> {};
+
+template<>
+struct arg_traits<blob> {
+    static constexpr char tag = 'b';
+    static constexpr int32_t count(const blob&) { return 1; }
+    static constexpr int32_t size(const blob& b) { return 4 + roundup(b.size); }
+    static char * write_tags(char *tags, const blob&){
+        *tags = 'b';
+        return tags + 1;
+    }
+    static char * write(char *data, const blob& b){
+        to_bytes<int32_t>(b.size, data);
+        auto n = roundup(b.size);
+        if (n > 0){
+            memset(data + n, 0, 4); // first zero pad the last four bytes
+            memcpy(data + 4, b.data, b.size);
+        }
+        return data + 4 + n;
+    }
+    static const char * read(const char *data, const char *end, blob& b){
+        if ((end - data) < 4){
+            return nullptr;
+        }
+        auto size = from_bytes<int32_t>(data);
+        // check the raw size first, rounding up could overflow!
+        auto limit = end - data - 4;
+        if (size < 0 || size > limit || roundup(size) > limit){
+            return nullptr;
+        }
+        b = blob(data + 4, size);
+        return data + 4 + roundup(size);
+    }
+};
+
+template<>
+struct arg_traits<int32_list> {
+    static constexpr int32_t count(const int32_list& l) { return l.size; }
+    static constexpr int32_t size(const int32_list& l) { return l.size * 4; }
+    static char * write_tags(char *tags, const int32_list& l){
+        memset(tags, 'i', l.size);
+        return tags + l.size;
+    }
+    static char * write(char *data, const int32_list& l){
+        to_bytes<int32_t>(l.data, data, l.size);
+        return data + l.size * 4;
+    }
+};
+
+constexpr int32_t schema_count() { return 0; } // sentinel
+
+template<typename T, typename... U>
+constexpr int32_t schema_count(const T& arg, const U&... args){
+    return arg_traits<T>::count(arg) + schema_count(args...);
+}
+
+constexpr int32_t schema_size() { return 0; } // sentinel
+
+template<typename T, typename... U>
+constexpr int32_t schema_size(const T& arg, const U&... args){
+    return arg_traits<T>::size(arg) + schema_size(args...);
+}
+
+inline char * schema_write_tags(char *tags) { return tags; } // sentinel
+
+template<typename T, typename... U>
+char * schema_write_tags(char *tags, const T& arg, const U&... args){
+    return schema_write_tags(arg_traits<T>::write_tags(tags, arg), args...);
+}
+
+inline char * schema_write(char *data) { return data; } // sentinel
+
+template<typename T, typename... U>
+char * schema_write(char *data, const T& arg, const U&... args){
+    return schema_write(arg_traits<T>::write(data, arg), args...);
+}
+
+inline bool schema_match_tags(const char *tags) { return *tags == '\0'; } // sentinel
+
+template<typename T, typename... U>
+bool schema_match_tags(const char *tags, const T& arg, const U&... args){
+    return *tags == arg_traits<T>::tag && schema_match_tags(tags + 1, args...);
+}
+
+inline const char * schema_read(const char *data, const char *) { return data; } // sentinel
+
+template<typename T, typename... U>
+const char * schema_read(const char *data, const char *end, T& arg, U&... args){
+    data = arg_traits<T>::read(data, end, arg);
+    return data ? schema_read(data, end, args...) : nullptr;
+}
+
+} // detail
+
+template<typename... T>
+int32_t message_schema<T...>::write(char *buf, int32_t size, const char *address,
+                                    int32_t addrsize, const T&... args){
+    // for scalar arguments these are compile time constants
+    const int32_t addrlen = detail::roundup(addrsize + 1); // include null terminator
+    const int32_t taglen = detail::roundup(detail::schema_count(args...) + 2); // include ',' and '0'
+    const int32_t total = addrlen + taglen + detail::schema_size(args...);
+    if (total > size){
+        return 0;
+    }
+    // address pattern
+    memset(buf + addrlen - 4, 0, 4); // zero pad last 4 bytes
+    memcpy(buf, address, addrsize);
+    // type tags
+    auto tags = buf + addrlen;
+    memset(tags + taglen - 4, 0, 4); // zero pad last 4 bytes
+    *tags = ',';
+    detail::schema_write_tags(tags + 1, args...);
+    // arguments
+    detail::schema_write(tags + taglen, args...);
+    return total;
+}
+
+template<typename... T>
+bool message_schema<T...>::read(const char *msg, int32_t size, T&... args){
+    // packet size must be multiple of 4!
+    if (size < 8 || (size & 3) != 0){
+        return false;
+    }
+    auto end = msg + size;
+    auto len = detail::strlen_safe(msg, end);
+    if (len < 0){
+        return false;
+    }
+    // the type tags must match exactly
+    auto tags = msg + detail::roundup(len + 1);
+    const int32_t taglen = detail::roundup(nargs + 2); // include ',' and '0'
+    if ((end - tags) < taglen || *tags != ','
+            || !detail::schema_match_tags(tags + 1, args...)){
+        return false;
+    }
+    // arguments at fixed offsets (except after a blob)
+    return detail::schema_read(tags + taglen, end, args...) != nullptr;
+}
+
 } // osc
 } // aoo
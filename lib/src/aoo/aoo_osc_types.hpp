@@ -79,6 +79,15 @@ struct blob {
     int32_t size;
 };
 
+// a list of int32 arguments (variable length)
+struct int32_list {
+    int32_list(const int32_t *_data = nullptr, int32_t _size = 0)
+        : data(_data), size(_size){}
+
+    const int32_t *data;
+    int32_t size;
+};
+
 class arg_iterator {
 public:
     arg_iterator(const char *typetag, const char *data, const char *end)
@@ -194,6 +203,54 @@ private:
     int32_t nargs_;
 };
 
+class received_bundle {
+public:
+    class iterator {
+    public:
+        iterator(const char *data, const char *end)
+            : data_(data), end_(end){ validate(); }
+
+        iterator& operator++(){
+            advance();
+            return *this;
+        }
+        iterator operator++(int){
+            iterator temp(*this);
+            advance();
+            return temp;
+        }
+        received_packet operator*() const;
+
+        bool operator==(const iterator& other) const {
+            return other.data_ == data_;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return other.data_ != data_;
+        }
+    private:
+        void advance();
+        void validate();
+
+        const char *data_;
+        const char *end_;
+    };
+
+    received_bundle(const received_packet& packet);
+
+    bool check() const { return data_ != nullptr; }
+
+    timetag time() const { return time_; }
+
+    iterator begin() const { return iterator(data_, end_); }
+
+    iterator end() const { return iterator(end_, end_); }
+private:
+    const char *data_;
+    const char *end_;
+    timetag time_;
+};
+
 class message_builder {
 public:
     message_builder(char *buffer, int32_t size);
@@ -243,6 +300,23 @@ private:
     message_builder& add_string(const char *s, int32_t n);
 };
 
+// message with a fixed argument list. the type tags and the argument layout
+// are known at compile time, so serializing only takes a few stores.
+// variable length arguments (blob, int32_list) only add a runtime size.
+template<typename... T>
+class message_schema {
+public:
+    static constexpr int32_t nargs = sizeof...(T);
+
+    // returns the message size or 0 if the buffer is too small
+    static int32_t write(char *buf, int32_t size, const char *address,
+                         int32_t addrsize, const T&... args);
+
+    // check the type tags and read all arguments (not for int32_list).
+    // returns false if the message doesn't match or is malformed.
+    static bool read(const char *msg, int32_t size, T&... args);
+};
+
 } // osc
 } // aoo
 
@@ -10,6 +10,7 @@ extern "C"
 /*/////////////////// PCM codec ////////////////////////*/
 
 #define AOO_CODEC_PCM "pcm"
+#define AOO_CODEC_PCM_ID 0
 
 typedef enum
 {
@@ -17,6 +18,9 @@ typedef enum
     AOO_PCM_INT24,
     AOO_PCM_FLOAT32,
     AOO_PCM_FLOAT64,
+    AOO_PCM_ULAW, // 8 bit G.711 mu-law
+    AOO_PCM_ALAW, // 8 bit G.711 A-law
+    AOO_PCM_FLOAT16, // IEEE 754 half precision
     AOO_PCM_BITDEPTH_SIZE
 } aoo_pcm_bitdepth;
 
@@ -4,6 +4,10 @@
 #include <cstring>
 #include <iostream>
 
+#ifdef _MSC_VER
+# include <stdlib.h> // _byteswap_*
+#endif
+
 /*------------------ alloca -----------------------*/
 #ifdef _WIN32
 # include <malloc.h> // MSVC or mingw on windows
@@ -70,34 +74,84 @@
 
 namespace aoo {
 
+namespace detail {
+
+#if defined(_MSC_VER)
+inline uint16_t bswap(uint16_t x){ return _byteswap_ushort(x); }
+inline uint32_t bswap(uint32_t x){ return _byteswap_ulong(x); }
+inline uint64_t bswap(uint64_t x){ return _byteswap_uint64(x); }
+#elif defined(__GNUC__) || defined(__clang__)
+inline uint16_t bswap(uint16_t x){ return __builtin_bswap16(x); }
+inline uint32_t bswap(uint32_t x){ return __builtin_bswap32(x); }
+inline uint64_t bswap(uint64_t x){ return __builtin_bswap64(x); }
+#else
+inline uint16_t bswap(uint16_t x){
+    return (x << 8) | (x >> 8);
+}
+inline uint32_t bswap(uint32_t x){
+    return ((uint32_t)bswap((uint16_t)x) << 16) | bswap((uint16_t)(x >> 16));
+}
+inline uint64_t bswap(uint64_t x){
+    return ((uint64_t)bswap((uint32_t)x) << 32) | bswap((uint32_t)(x >> 32));
+}
+#endif
+inline uint8_t bswap(uint8_t x){ return x; }
+
+template<size_t N>
+struct uint_type;
+
+template<> struct uint_type<1> { using type = uint8_t; };
+template<> struct uint_type<2> { using type = uint16_t; };
+template<> struct uint_type<4> { using type = uint32_t; };
+template<> struct uint_type<8> { using type = uint64_t; };
+
+} // detail
+
+// read/write big endian values from/to (possibly unaligned) memory.
+// memcpy compiles to a single load resp. store.
+
 template<typename T>
 T from_bytes(const char *b){
-    union {
-        T t;
-        char b[sizeof(T)];
-    } c;
+    typename detail::uint_type<sizeof(T)>::type u;
+    memcpy(&u, b, sizeof(T));
+#if BYTE_ORDER != BIG_ENDIAN
+    u = detail::bswap(u);
+#endif
+    T t;
+    memcpy(&t, &u, sizeof(T));
+    return t;
+}
+
+template<typename T>
+void to_bytes(T v, char *b){
+    typename detail::uint_type<sizeof(T)>::type u;
+    memcpy(&u, &v, sizeof(T));
+#if BYTE_ORDER != BIG_ENDIAN
+    u = detail::bswap(u);
+#endif
+    memcpy(b, &u, sizeof(T));
+}
+
+// bulk conversion of n values (the loops can be vectorized)
+
+template<typename T>
+void from_bytes(const char *b, T *out, int32_t n){
 #if BYTE_ORDER == BIG_ENDIAN
-    memcpy(c.b, b, sizeof(T));
+    memcpy(out, b, n * sizeof(T));
 #else
-    for (size_t i = 0; i < sizeof(T); ++i){
-        c.b[i] = b[sizeof(T) - i - 1];
+    for (int32_t i = 0; i < n; ++i){
+        out[i] = from_bytes<T>(b + i * sizeof(T));
     }
 #endif
-    return c.t;
 }
 
 template<typename T>
-void to_bytes(T v, char *b){
-    union {
-        T t;
-        char b[sizeof(T)];
-    } c;
-    c.t = v;
+void to_bytes(const T *in, char *b, int32_t n){
 #if BYTE_ORDER == BIG_ENDIAN
-    memcpy(b, c.b, sizeof(T));
+    memcpy(b, in, n * sizeof(T));
 #else
-    for (size_t i = 0; i < sizeof(T); ++i){
-        b[i] = c.b[sizeof(T) - i - 1];
+    for (int32_t i = 0; i < n; ++i){
+        to_bytes<T>(in[i], b + i * sizeof(T));
     }
 #endif
 }
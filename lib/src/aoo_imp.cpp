@@ -2,30 +2,51 @@
 #include "aoo/aoo_utils.hpp"
 #include "aoo/aoo_pcm.h"
 #include "aoo/aoo_opus.h"
+#include "aoo/aoo_lossless.h"
+#include "aoo/aoo_opus_custom.h"
 #include "aoo_imp.hpp"
 
-#include <unordered_map>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 
 namespace aoo {
 
-static std::unordered_map<std::string, std::unique_ptr<aoo::codec>> codec_dict;
+// indexed by codec ID
+static std::unique_ptr<aoo::codec> codec_table[AOO_CODEC_MAXNUM];
 
 void register_codec(const char *name, const aoo_codec *codec){
-    LOG_VERBOSE("aoo: registered codec '" << name << "'");
-    codec_dict[name] = std::make_unique<aoo::codec>(codec);
+    auto id = codec->id;
+    if (id < 0 || id >= AOO_CODEC_MAXNUM){
+        LOG_ERROR("aoo: codec '" << name << "' has bad ID " << id);
+        return;
+    }
+    if (codec_table[id]){
+        LOG_ERROR("aoo: can't register codec '" << name << "' - ID " << id
+                  << " already taken by '" << codec_table[id]->name() << "'");
+        return;
+    }
+    LOG_VERBOSE("aoo: registered codec '" << name << "' (ID " << id << ")");
+    codec_table[id] = std::make_unique<aoo::codec>(codec);
 }
 
-const aoo::codec * find_codec(const std::string& name){
-    auto it = codec_dict.find(name);
-    if (it != codec_dict.end()){
-        return it->second.get();
+const aoo::codec * find_codec(int32_t id){
+    if (id >= 0 && id < AOO_CODEC_MAXNUM){
+        return codec_table[id].get();
     } else {
         return nullptr;
     }
 }
 
+const aoo::codec * find_codec(const char *name){
+    for (auto& c : codec_table){
+        if (c && !strcmp(c->name(), name)){
+            return c.get();
+        }
+    }
+    return nullptr;
+}
+
 constexpr bool is_pow2(int32_t i){
     return (i & (i - 1)) == 0;
 }
@@ -35,21 +56,85 @@ constexpr bool is_pow2(int32_t i){
 /*//////////////////// OSC ////////////////////////////*/
 
 int32_t aoo_parsepattern(const char *msg, int32_t n, int32_t *id){
-    int32_t offset = sizeof(AOO_DOMAIN) - 1;
-    if (n < (offset + 2)){
+    const int32_t offset = sizeof(AOO_DOMAIN) - 1;
+    if (n < (offset + 2) || memcmp(msg, AOO_DOMAIN, offset) || msg[offset] != '/'){
         return 0;
     }
-    if (!memcmp(msg, AOO_DOMAIN, offset)){
-        if (!memcmp(msg + offset, "/*", 2)){
-            *id = AOO_ID_WILDCARD; // wildcard
-            return offset + 2;
+    auto it = msg + offset + 1;
+    auto end = msg + n;
+    if (*it == '*'){
+        *id = AOO_ID_WILDCARD; // wildcard
+        return offset + 2;
+    }
+    // parse decimal ID (without sign)
+    int64_t result = 0;
+    auto start = it;
+    while (it != end && *it >= '0' && *it <= '9'){
+        result = result * 10 + (*it++ - '0');
+        if (result > INT32_MAX){
+            return 0;
         }
-        int32_t skip = 0;
-        if (sscanf(&msg[offset], "/%d%n", id, &skip) > 0){
-            return offset + skip;
+    }
+    if (it == start){
+        return 0;
+    }
+    *id = (int32_t)result;
+    return it - msg;
+}
+
+namespace {
+
+// compare the rest of the address pattern, including the null terminator
+bool match_type(const char *s, const char *end, const char *type, int32_t size){
+    return (end - s) >= size && !memcmp(s, type, size);
+}
+
+} // namespace
+
+aoo_msgtype aoo_parsemessage(const char *msg, int32_t n, int32_t *id){
+    if (aoo::is_binary_data(msg, n)){
+        *id = aoo::from_bytes<int32_t>(msg + 4);
+        return AOO_MSG_DATA;
+    }
+    auto onset = aoo_parsepattern(msg, n, id);
+    if (!onset){
+        return AOO_MSG_NONE;
+    }
+    auto s = msg + onset;
+    auto end = msg + n;
+    if ((end - s) < 2 || *s != '/'){
+        return AOO_MSG_UNKNOWN;
+    }
+    // dispatch on the first character
+    switch (s[1]){
+    case 'd':
+        if (match_type(s, end, AOO_DATA, sizeof(AOO_DATA))){
+            return AOO_MSG_DATA;
+        }
+        break;
+    case 'f':
+        if (match_type(s, end, AOO_FORMAT, sizeof(AOO_FORMAT))){
+            return AOO_MSG_FORMAT;
+        }
+        break;
+    case 'r':
+        if (match_type(s, end, AOO_RESEND, sizeof(AOO_RESEND))){
+            return AOO_MSG_RESEND;
+        } else if (match_type(s, end, AOO_REQUEST, sizeof(AOO_REQUEST))){
+            return AOO_MSG_REQUEST;
+        }
+        break;
+    case 'p':
+        if (match_type(s, end, AOO_PING, sizeof(AOO_PING))){
+            return AOO_MSG_PING;
+        } else if (match_type(s, end, AOO_PONG, sizeof(AOO_PONG))){
+            return AOO_MSG_PONG;
         }
+        break;
+    default:
+        break;
     }
-    return 0;
+    return AOO_MSG_UNKNOWN;
 }
 
 // OSC time stamp (NTP time)
@@ -95,14 +180,262 @@ uint64_t aoo_osctime_addseconds(uint64_t t, double s){
     return (rh << 32) + rl;
 }
 
+/*////////////////////////// stream transport /////////////////////////////*/
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+int32_t aoo_stream_frame(aoo_framing framing, const char *msg, int32_t n,
+                         char *buf, int32_t size){
+    if (framing == AOO_FRAMING_SIZE){
+        if (n + 4 > size){
+            return 0;
+        }
+        aoo::to_bytes<int32_t>(n, buf);
+        memcpy(buf + 4, msg, n);
+        return n + 4;
+    } else {
+        // double ended SLIP: END <escaped message> END
+        int32_t j = 0;
+        if (j >= size){
+            return 0;
+        }
+        buf[j++] = (char)SLIP_END;
+        for (int32_t i = 0; i < n; ++i){
+            auto c = (uint8_t)msg[i];
+            if (c == SLIP_END || c == SLIP_ESC){
+                if (j + 2 > size){
+                    return 0;
+                }
+                buf[j++] = (char)SLIP_ESC;
+                buf[j++] = (char)(c == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC);
+            } else {
+                if (j + 1 > size){
+                    return 0;
+                }
+                buf[j++] = (char)c;
+            }
+        }
+        if (j >= size){
+            return 0;
+        }
+        buf[j++] = (char)SLIP_END;
+        return j;
+    }
+}
+
+aoo_stream_reader * aoo_stream_reader_new(aoo_framing framing){
+    return new aoo_stream_reader(framing);
+}
+
+void aoo_stream_reader_free(aoo_stream_reader *reader){
+    delete reader;
+}
+
+void aoo_stream_reader_reset(aoo_stream_reader *reader){
+    reader->reset();
+}
+
+int32_t aoo_stream_reader_feed(aoo_stream_reader *reader, const char *data, int32_t n,
+                               void *user, aoo_messagefn fn){
+    return reader->feed(data, n, user, fn);
+}
+
+void aoo_stream_reader::reset(){
+    buffer_.clear();
+    size_ = 0;
+    escape_ = false;
+    skip_ = false;
+}
+
+int32_t aoo_stream_reader::feed(const char *data, int32_t n, void *user, aoo_messagefn fn){
+    if (framing_ == AOO_FRAMING_SIZE){
+        return feed_size(data, n, user, fn);
+    } else {
+        return feed_slip(data, n, user, fn);
+    }
+}
+
+int32_t aoo_stream_reader::feed_size(const char *data, int32_t n, void *user, aoo_messagefn fn){
+    int32_t count = 0;
+    while (n > 0){
+        if (buffer_.empty()){
+            // fast path: pass complete messages without copying
+            while (n >= 4){
+                auto size = aoo::from_bytes<int32_t>(data);
+                if (size <= 0 || size > AOO_STREAM_MAXMSGSIZE){
+                    LOG_ERROR("stream: bad message size " << size);
+                    reset();
+                    return -1;
+                }
+                if (size > n - 4){
+                    break; // incomplete
+                }
+                fn(user, data + 4, size);
+                count++;
+                data += size + 4;
+                n -= size + 4;
+            }
+            if (n == 0){
+                break;
+            }
+        }
+        // get size prefix
+        if (buffer_.size() < 4){
+            auto m = std::min<int32_t>(4 - buffer_.size(), n);
+            buffer_.insert(buffer_.end(), data, data + m);
+            data += m;
+            n -= m;
+            if (buffer_.size() < 4){
+                break;
+            }
+            size_ = aoo::from_bytes<int32_t>(buffer_.data());
+            if (size_ <= 0 || size_ > AOO_STREAM_MAXMSGSIZE){
+                LOG_ERROR("stream: bad message size " << size_);
+                reset();
+                return -1;
+            }
+        }
+        // get message
+        auto m = std::min<int32_t>(size_ + 4 - buffer_.size(), n);
+        buffer_.insert(buffer_.end(), data, data + m);
+        data += m;
+        n -= m;
+        if ((int32_t)buffer_.size() == size_ + 4){
+            fn(user, buffer_.data() + 4, size_);
+            count++;
+            buffer_.clear();
+        }
+    }
+    return count;
+}
+
+int32_t aoo_stream_reader::feed_slip(const char *data, int32_t n, void *user, aoo_messagefn fn){
+    int32_t count = 0;
+    auto end = data + n;
+    while (data != end){
+        if (buffer_.empty() && !escape_ && !skip_){
+            // fast path: pass frames without escape characters without copying
+            auto delim = (const char *)memchr(data, SLIP_END, end - data);
+            if (delim && !memchr(data, SLIP_ESC, delim - data)){
+                if (delim > data){
+                    fn(user, data, delim - data);
+                    count++;
+                }
+                data = delim + 1;
+                continue;
+            }
+        }
+        auto c = (uint8_t)*data++;
+        if (c == SLIP_END){
+            // end of frame (empty frames are ignored)
+            if (!buffer_.empty() && !skip_){
+                fn(user, buffer_.data(), buffer_.size());
+                count++;
+            }
+            buffer_.clear();
+            escape_ = false;
+            skip_ = false;
+            continue;
+        }
+        if (escape_){
+            escape_ = false;
+            if (c == SLIP_ESC_END){
+                c = SLIP_END;
+            } else if (c == SLIP_ESC_ESC){
+                c = SLIP_ESC;
+            } else {
+                LOG_WARNING("stream: bad SLIP escape sequence");
+                skip_ = true;
+            }
+        } else if (c == SLIP_ESC){
+            escape_ = true;
+            continue;
+        }
+        if (!skip_){
+            if (buffer_.size() < AOO_STREAM_MAXMSGSIZE){
+                buffer_.push_back(c);
+            } else {
+                LOG_WARNING("stream: SLIP frame too large");
+                buffer_.clear();
+                skip_ = true;
+            }
+        }
+    }
+    return count;
+}
+
 namespace aoo {
 
+/*////////////////////////// data packet /////////////////////////////*/
+
+bool check_data_packet(const data_packet& d){
+    if (d.nframes <= 0 || d.nframes > AOO_MAXNUMFRAMES
+            || d.framenum < 0 || d.framenum >= d.nframes
+            || d.size <= 0 || d.size > d.totalsize){
+        return false;
+    }
+    // all frames except the last one have the same size.
+    // (the last frame is copied to the end of the block.)
+    if (d.framenum < d.nframes - 1){
+        return (int64_t)(d.framenum + 1) * d.size <= d.totalsize;
+    }
+    return true;
+}
+
+/*////////////////////////// binary data /////////////////////////////*/
+
+int32_t write_binary_data(char *buf, int32_t size, int32_t sink, int32_t src,
+                          int32_t salt, const data_packet& d){
+    auto total = AOO_BINDATA_HEADERSIZE + d.size;
+    if (total > size){
+        return 0;
+    }
+    memcpy(buf, "AoO", 3);
+    buf[3] = AOO_BINDATA_VERSION;
+    to_bytes<int32_t>(sink, buf + 4);
+    to_bytes<int32_t>(src, buf + 8);
+    to_bytes<int32_t>(salt, buf + 12);
+    to_bytes<int32_t>(d.sequence, buf + 16);
+    to_bytes<uint64_t>(time_tag(d.time).to_uint64(), buf + 20);
+    to_bytes<double>(d.samplerate, buf + 28);
+    to_bytes<int32_t>(d.channel, buf + 36);
+    to_bytes<int32_t>(d.totalsize, buf + 40);
+    to_bytes<int32_t>(d.nframes, buf + 44);
+    to_bytes<int32_t>(d.framenum, buf + 48);
+    memcpy(buf + AOO_BINDATA_HEADERSIZE, d.data, d.size);
+    return total;
+}
+
+bool read_binary_data(const char *buf, int32_t size, int32_t& sink, int32_t& src,
+                      int32_t& salt, data_packet& d){
+    if (!is_binary_data(buf, size)){
+        return false;
+    }
+    sink = from_bytes<int32_t>(buf + 4);
+    src = from_bytes<int32_t>(buf + 8);
+    salt = from_bytes<int32_t>(buf + 12);
+    d.sequence = from_bytes<int32_t>(buf + 16);
+    d.time = time_tag(from_bytes<uint64_t>(buf + 20)).to_double();
+    d.samplerate = from_bytes<double>(buf + 28);
+    d.channel = from_bytes<int32_t>(buf + 36);
+    d.totalsize = from_bytes<int32_t>(buf + 40);
+    d.nframes = from_bytes<int32_t>(buf + 44);
+    d.framenum = from_bytes<int32_t>(buf + 48);
+    d.data = buf + AOO_BINDATA_HEADERSIZE;
+    d.size = size - AOO_BINDATA_HEADERSIZE;
+    return check_data_packet(d);
+}
+
 /*////////////////////////// block /////////////////////////////*/
 
-void block::set(int32_t seq, double sr, int32_t chn,
+void block::set(int32_t seq, double _time, double sr, int32_t chn,
              int32_t nbytes, int32_t nframes)
 {
     sequence = seq;
+    time = _time;
     samplerate = sr;
     channel = chn;
     numframes_ = nframes;
@@ -117,11 +450,12 @@ void block::set(int32_t seq, double sr, int32_t chn,
     // LOG_DEBUG("initial frames: " << (unsigned)frames);
 }
 
-void block::set(int32_t seq, double sr, int32_t chn,
+void block::set(int32_t seq, double _time, double sr, int32_t chn,
                 const char *data, int32_t nbytes,
                 int32_t nframes, int32_t framesize)
 {
     sequence = seq;
+    time = _time;
     samplerate = sr;
     channel = chn;
     numframes_ = nframes;
@@ -544,7 +878,7 @@ block * history_buffer::find(int32_t seq){
     return nullptr;
 }
 
-void history_buffer::push(int32_t seq, double sr,
+void history_buffer::push(int32_t seq, double time, double sr,
                           const char *data, int32_t nbytes,
                           int32_t nframes, int32_t framesize)
 {
@@ -556,7 +890,7 @@ void history_buffer::push(int32_t seq, double sr,
     if (buffer_[head_].sequence >= 0){
         oldest_ = buffer_[head_].sequence;
     }
-    buffer_[head_].set(seq, sr, 0, data, nbytes, nframes, framesize);
+    buffer_[head_].set(seq, time, sr, 0, data, nbytes, nframes, framesize);
     if (++head_ >= (int32_t)buffer_.size()){
         head_ = 0;
     }
@@ -589,7 +923,7 @@ int32_t block_queue::capacity() const {
     return blocks_.size();
 }
 
-block* block_queue::insert(int32_t seq, double sr, int32_t chn,
+block* block_queue::insert(int32_t seq, double time, double sr, int32_t chn,
               int32_t nbytes, int32_t nframes){
     assert(capacity() > 0);
     // find pos to insert
@@ -646,7 +980,7 @@ block* block_queue::insert(int32_t seq, double sr, int32_t chn,
         size_++;
     }
     // replace data
-    it->set(seq, sr, chn, nbytes, nframes);
+    it->set(seq, time, sr, chn, nbytes, nframes);
     return it;
 }
 
@@ -724,6 +1058,64 @@ std::ostream& operator<<(std::ostream& os, const block_queue& b){
     return os;
 }
 
+/*////////////////////////// rtt_estimator /////////////////////////////*/
+
+// smoothing as in RFC 6298 (TCP retransmission timer)
+#define AOO_RTT_ALPHA 0.125
+#define AOO_RTT_BETA 0.25
+
+void rtt_estimator::reset(){
+    srtt_ = 0;
+    rttvar_ = 0;
+    count_ = 0;
+}
+
+void rtt_estimator::update(double rtt){
+    if (rtt < 0){
+        return; // bogus time stamps
+    }
+    if (count_ == 0){
+        srtt_ = rtt;
+        rttvar_ = rtt * 0.5;
+    } else {
+        rttvar_ += AOO_RTT_BETA * (std::abs(srtt_ - rtt) - rttvar_);
+        srtt_ += AOO_RTT_ALPHA * (rtt - srtt_);
+    }
+    count_++;
+}
+
+/*////////////////////////// clock_offset /////////////////////////////*/
+
+void clock_offset::reset(){
+    offset_ = 0;
+    head_ = 0;
+    count_ = 0;
+}
+
+void clock_offset::update(double t1, double t2, double t4){
+    auto delay = t4 - t1;
+    if (delay < 0){
+        return; // bogus time stamps
+    }
+    // assume symmetric network delay
+    samples_[head_].delay = delay;
+    samples_[head_].offset = t2 - (t1 + t4) * 0.5;
+    if (++head_ >= size){
+        head_ = 0;
+    }
+    if (count_ < size){
+        count_++;
+    }
+    // use the sample with the shortest round trip time
+    auto best = &samples_[0];
+    for (int i = 1; i < count_; ++i){
+        if (samples_[i].delay < best->delay){
+            best = &samples_[i];
+        }
+    }
+    offset_ = best->offset;
+}
+
 /*////////////////////////// dynamic_resampler /////////////////////////////*/
 
 #define AOO_RESAMPLER_SPACE 3
@@ -790,6 +1182,26 @@ void dynamic_resampler::write(const aoo_sample *data, int32_t n){
     balance_ += n;
 }
 
+void dynamic_resampler::write_zeros(int32_t n){
+    auto size = (int32_t)buffer_.size();
+    auto end = wrpos_ + n;
+    int32_t n1, n2;
+    if (end > size){
+        n1 = size - wrpos_;
+        n2 = end - size;
+    } else {
+        n1 = n;
+        n2 = 0;
+    }
+    std::fill(&buffer_[wrpos_], &buffer_[wrpos_] + n1, 0);
+    std::fill(&buffer_[0], &buffer_[0] + n2, 0);
+    wrpos_ += n;
+    if (wrpos_ >= size){
+        wrpos_ -= size;
+    }
+    balance_ += n;
+}
+
 int32_t dynamic_resampler::read_available(){
     return balance_ * ratio_;
 }
@@ -843,6 +1255,8 @@ void dynamic_resampler::read(aoo_sample *data, int32_t n){
 void aoo_setup(){
     aoo_codec_pcm_setup(aoo::register_codec);
     aoo_codec_opus_setup(aoo::register_codec);
+    aoo_codec_lossless_setup(aoo::register_codec);
+    aoo_codec_opus_custom_setup(aoo::register_codec); // no-op if disabled
 }
 
 void aoo_close() {}
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "aoo/aoo.h"
+#include "aoo/aoo_osc.hpp"
 
 #include <vector>
 #include <memory>
 #include <atomic>
+#include <algorithm>
+#include <cstring>
 
 namespace aoo {
 
@@ -52,8 +55,11 @@ public:
     void update(double srfrom, double srto);
     int32_t write_available();
     void write(const aoo_sample* data, int32_t n);
+    void write_zeros(int32_t n);
     int32_t read_available();
     void read(aoo_sample* data, int32_t n);
+    // buffered samples at the source samplerate
+    double balance() const { return balance_; }
 private:
     std::vector<aoo_sample> buffer_;
     int32_t nchannels_ = 0;
@@ -85,6 +91,9 @@ public:
     const char *name() const {
         return codec_->name;
     }
+    int32_t id() const {
+        return codec_->id;
+    }
     void setup(aoo_format& fmt){
         codec_->encoder_setup(obj_, &fmt);
         // assign after validation!
@@ -116,9 +125,18 @@ public:
     const char *name() const {
         return codec_->name;
     }
+    int32_t id() const {
+        return codec_->id;
+    }
     int32_t decode(const char *buf, int32_t size, aoo_sample *s, int32_t n){
         return codec_->decoder_decode(obj_, buf, size, s, n);
     }
+    bool can_recover() const {
+        return codec_->decoder_recover != nullptr;
+    }
+    int32_t recover(const char *buf, int32_t size, aoo_sample *s, int32_t n){
+        return codec_->decoder_recover(obj_, buf, size, s, n);
+    }
     int32_t read(int32_t nchannels, int32_t samplerate, int32_t blocksize,
                  const char *opt, int32_t size){
         auto result = codec_->decoder_read(obj_, nchannels, samplerate,
@@ -142,6 +160,9 @@ public:
     const char *name() const {
         return codec_->name;
     }
+    int32_t id() const {
+        return codec_->id;
+    }
     std::unique_ptr<encoder> create_encoder() const {
         auto obj = codec_->encoder_new();
         if (obj){
@@ -162,10 +183,74 @@ private:
     const aoo_codec *codec_;
 };
 
-const codec * find_codec(const std::string& name);
+const codec * find_codec(int32_t id);
+
+const codec * find_codec(const char *name);
+
+// max. number of idle encoder/decoder instances kept for reuse
+#ifndef AOO_CODEC_POOLSIZE
+#define AOO_CODEC_POOLSIZE 4
+#endif
+
+// keeps encoder/decoder instances which are not in use, so that
+// switching back and forth between codecs doesn't have to
+// allocate and initialize them from scratch.
+// NOTE: pre-built instances don't have a format yet; codec state which
+// depends on the format (e.g. the Opus encoder/decoder) is still created
+// when the format is first applied.
+template<typename T>
+class codec_pool {
+public:
+    codec_pool(){
+        pool_.reserve(AOO_CODEC_POOLSIZE);
+    }
+    // take an instance for the given codec;
+    // returns nullptr if there is none.
+    std::unique_ptr<T> take(int32_t id){
+        for (auto it = pool_.begin(); it != pool_.end(); ++it){
+            if ((*it)->id() == id){
+                auto result = std::move(*it);
+                pool_.erase(it);
+                return result;
+            }
+        }
+        return nullptr;
+    }
+    // pre-build one instance for every registered codec except 'current'
+    // (as long as there is room); 'create' takes a codec and returns a new instance.
+    template<typename F>
+    void fill(int32_t current, F&& create){
+        for (int32_t id = 0; id < AOO_CODEC_MAXNUM
+             && pool_.size() < AOO_CODEC_POOLSIZE; ++id){
+            auto c = find_codec(id);
+            if (c && id != current && !contains(id)){
+                auto obj = create(*c);
+                if (obj){
+                    pool_.push_back(std::move(obj));
+                }
+            }
+        }
+    }
+    // put back an instance; drops the oldest one if the pool is full.
+    void put(std::unique_ptr<T> obj){
+        if (obj){
+            if (pool_.size() >= AOO_CODEC_POOLSIZE){
+                pool_.erase(pool_.begin());
+            }
+            pool_.push_back(std::move(obj));
+        }
+    }
+private:
+    bool contains(int32_t id) const {
+        return std::find_if(pool_.begin(), pool_.end(),
+            [&](auto& obj){ return obj->id() == id; }) != pool_.end();
+    }
+    std::vector<std::unique_ptr<T>> pool_;
+};
 
 struct data_packet {
     int32_t sequence;
+    double time;
     double samplerate;
     int32_t channel;
     int32_t totalsize;
@@ -175,12 +260,61 @@ struct data_packet {
     int32_t size;
 };
 
+// max. number of frames per block (see block::frames_)
+#define AOO_MAXNUMFRAMES 64
+
+// check that the frame fits into the block, so that incoming
+// packets can be safely passed to block::add_frame().
+bool check_data_packet(const data_packet& d);
+
+// OSC messages with fixed argument lists (see aoo/aoo.h)
+
+// /AoO/<sink>/data <src> <salt> <seq> <time> <sr> <channel_onset> <totalsize> <nframes> <frame> <data>
+using data_message = osc::message_schema<int32_t, int32_t, int32_t, osc::timetag,
+    double, int32_t, int32_t, int32_t, int32_t, osc::blob>;
+// older sources don't send the capture time
+using data_message_notime = osc::message_schema<int32_t, int32_t, int32_t,
+    double, int32_t, int32_t, int32_t, int32_t, osc::blob>;
+
+// /AoO/<sink>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <options...> [<flags>]
+using format_message = osc::message_schema<int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, osc::blob>;
+using format_message_flags = osc::message_schema<int32_t, int32_t, int32_t, int32_t,
+    int32_t, int32_t, osc::blob, int32_t>;
+
+// /AoO/<src>/request <sink> [<flags>]
+using request_message = osc::message_schema<int32_t>;
+using request_message_flags = osc::message_schema<int32_t, int32_t>;
+
+// /AoO/<src>/resend <sink> <salt> <seq0> <frame0> <seq1> <frame1> ...
+using resend_message = osc::message_schema<int32_t, int32_t, osc::int32_list>;
+
+// binary /data message (all fields big endian):
+// 'A' 'o' 'O' <version> <sink> <src> <salt> <seq> <time> <sr> <channel_onset>
+// <totalsize> <nframes> <frame> <data...>
+
+#define AOO_BINDATA_VERSION 1
+#define AOO_BINDATA_HEADERSIZE 52
+
+// returns the message size or 0 on failure
+int32_t write_binary_data(char *buf, int32_t size, int32_t sink, int32_t src,
+                          int32_t salt, const data_packet& d);
+
+// returns false if the message is malformed
+bool read_binary_data(const char *buf, int32_t size, int32_t& sink, int32_t& src,
+                      int32_t& salt, data_packet& d);
+
+inline bool is_binary_data(const char *buf, int32_t size){
+    return size >= AOO_BINDATA_HEADERSIZE && !memcmp(buf, "AoO", 3)
+            && buf[3] == AOO_BINDATA_VERSION;
+}
+
 class block {
 public:
     // methods
-    void set(int32_t seq, double sr, int32_t chn,
+    void set(int32_t seq, double time, double sr, int32_t chn,
           int32_t nbytes, int32_t nframes);
-    void set(int32_t seq, double sr, int32_t chn,
+    void set(int32_t seq, double time, double sr, int32_t chn,
              const char *data, int32_t nbytes,
              int32_t nframes, int32_t framesize);
     const char* data() const { return buffer_.data(); }
@@ -192,6 +326,7 @@ public:
     int32_t num_frames() const { return numframes_; }
     // data
     int32_t sequence = -1;
+    double time = 0; // capture time (0: unknown)
     double samplerate = 0;
     int32_t channel = 0;
 protected:
@@ -209,7 +344,7 @@ public:
     bool full() const;
     int32_t size() const;
     int32_t capacity() const;
-    block* insert(int32_t seq, double sr, int32_t chn,
+    block* insert(int32_t seq, double time, double sr, int32_t chn,
                   int32_t nbytes, int32_t nframes);
     block* find(int32_t seq);
     void pop_front();
@@ -280,7 +415,7 @@ public:
     int32_t capacity() const;
     void resize(int32_t n);
     block * find(int32_t seq);
-    void push(int32_t seq, double sr,
+    void push(int32_t seq, double time, double sr,
              const char *data, int32_t nbytes,
              int32_t nframes, int32_t framesize);
 private:
@@ -289,6 +424,58 @@ private:
     int32_t head_ = 0;
 };
 
+class rtt_estimator {
+public:
+    void reset();
+    void update(double rtt);
+    bool valid() const { return count_ > 0; }
+    double rtt() const { return srtt_; }
+    double jitter() const { return rttvar_; }
+private:
+    double srtt_ = 0;
+    double rttvar_ = 0;
+    int32_t count_ = 0;
+};
+
+// estimate the offset between our clock and the clock of a peer
+// (NTP style). From the last N samples we pick the one with the
+// shortest round trip time, because it is the least affected by
+// asymmetric network delays.
+class clock_offset {
+public:
+    static const int32_t size = 8;
+
+    clock_offset(){}
+    clock_offset(const clock_offset& other)
+        : offset_(other.offset_.load()),
+          head_(other.head_), count_(other.count_){
+        std::copy(other.samples_, other.samples_ + size, samples_);
+    }
+    clock_offset& operator=(const clock_offset& other){
+        offset_ = other.offset_.load();
+        head_ = other.head_;
+        count_ = other.count_;
+        std::copy(other.samples_, other.samples_ + size, samples_);
+        return *this;
+    }
+    void reset();
+    // t1: ping sent (our clock), t2: ping received (peer clock),
+    // t4: pong received (our clock)
+    void update(double t1, double t2, double t4);
+    bool valid() const { return count_ > 0; }
+    // peer clock - our clock in seconds
+    double get() const { return offset_.load(); }
+private:
+    struct sample {
+        double delay;
+        double offset;
+    };
+    sample samples_[size];
+    std::atomic<double> offset_{0};
+    int32_t head_ = 0;
+    int32_t count_ = 0;
+};
+
 class threadsafe_counter {
 public:
     threadsafe_counter()
@@ -308,3 +495,25 @@ private:
 };
 
 } // aoo
+
+/*////////////////////////// stream transport /////////////////////////////*/
+
+// upper limit for framed messages, protects against corrupted streams
+#define AOO_STREAM_MAXMSGSIZE 65536
+
+struct aoo_stream_reader {
+    aoo_stream_reader(aoo_framing framing)
+        : framing_(framing){}
+
+    int32_t feed(const char *data, int32_t n, void *user, aoo_messagefn fn);
+    void reset();
+private:
+    int32_t feed_slip(const char *data, int32_t n, void *user, aoo_messagefn fn);
+    int32_t feed_size(const char *data, int32_t n, void *user, aoo_messagefn fn);
+
+    aoo_framing framing_;
+    std::vector<char> buffer_;
+    int32_t size_ = 0; // size prefix of the current message
+    bool escape_ = false; // SLIP escape character pending
+    bool skip_ = false; // discard the current SLIP frame
+};
@@ -0,0 +1,549 @@
+#include "aoo/aoo_lossless.h"
+#include "aoo/aoo_utils.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+// Each block is coded channel by channel. Every channel starts with an
+// 8 bit header (3 bit mode + 5 bit Rice parameter), followed by:
+// * fixed predictor (mode 0 - 4): <order> warm-up samples
+//   and the Rice coded prediction residuals
+// * constant (mode 5): a single sample
+// * verbatim (mode 6): all samples
+// samples are stored with the given bitdepth (two's complement).
+// the whole block is bit packed and padded to full bytes at the end.
+
+namespace {
+
+#define MAX_ORDER 4
+#define MODE_CONSTANT 5
+#define MODE_VERBATIM 6
+#define MAX_RICE_PARAM 31
+#define MAX_UNARY (1 << 28) // protect against malformed data
+
+/*/////////////////// sample conversion ////////////////////*/
+
+// same rounding and clipping as the PCM codec
+int32_t sample_to_int16(aoo_sample in){
+    float f = in * 0x7fff + 0.5f;
+    if (f >= 32767.f){
+        return INT16_MAX;
+    } else if (f > -32769.f){
+        return (int32_t)f;
+    } else {
+        return INT16_MIN; // also NaN
+    }
+}
+
+// the highest 3 bytes of a 32 bit integer
+int32_t sample_to_int24(aoo_sample in){
+    float f = in * 2147483648.f + 0.5f;
+    if (f >= 2147483648.f){
+        return 0x7fffff;
+    } else if (f >= -2147483648.f){
+        return (int32_t)f >> 8;
+    } else {
+        return -0x800000; // also NaN
+    }
+}
+
+aoo_sample int16_to_sample(int32_t in){
+    return (aoo_sample)in / 32768.f;
+}
+
+aoo_sample int24_to_sample(int32_t in){
+    return (aoo_sample)(int32_t)((uint32_t)in << 8) / 2147483648.f;
+}
+
+/*/////////////////// bit stream ////////////////////*/
+
+inline int clz64(uint64_t x){
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ULL)){
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+class bit_writer {
+public:
+    bit_writer(char *buf, int32_t size)
+        : buf_((uint8_t *)buf), size_(size){}
+    // nbits <= 32
+    void write(uint32_t value, int32_t nbits){
+        if (nbits < 32){
+            value &= (1u << nbits) - 1;
+        }
+        acc_ = (acc_ << nbits) | value;
+        nacc_ += nbits;
+        while (nacc_ >= 8){
+            nacc_ -= 8;
+            put(acc_ >> nacc_);
+        }
+    }
+    // q zeros followed by a one
+    void write_unary(uint32_t q){
+        while (q >= 32){
+            write(0, 32);
+            q -= 32;
+        }
+        write(1, q + 1);
+    }
+    // pad to full bytes
+    int32_t finish(){
+        if (nacc_ > 0){
+            put(acc_ << (8 - nacc_));
+            nacc_ = 0;
+        }
+        return pos_;
+    }
+    bool overflow() const { return pos_ > size_; }
+private:
+    void put(uint64_t byte){
+        if (pos_ < size_){
+            buf_[pos_] = (uint8_t)byte;
+        }
+        pos_++;
+    }
+    uint8_t *buf_;
+    int32_t size_;
+    int32_t pos_ = 0;
+    uint64_t acc_ = 0;
+    int32_t nacc_ = 0;
+};
+
+class bit_reader {
+public:
+    bit_reader(const char *buf, int32_t size)
+        : buf_((const uint8_t *)buf), size_(size){}
+    // nbits <= 32
+    uint32_t read(int32_t nbits){
+        if (nbits == 0){
+            return 0;
+        }
+        refill();
+        nacc_ -= nbits;
+        auto value = acc_ >> nacc_;
+        return nbits < 32 ? (uint32_t)value & ((1u << nbits) - 1) : (uint32_t)value;
+    }
+    // count zeros until the next one
+    uint32_t read_unary(){
+        uint32_t q = 0;
+        for (;;){
+            refill();
+            // left align the available bits
+            auto bits = acc_ << (64 - nacc_);
+            if (bits){
+                auto n = clz64(bits);
+                nacc_ -= n + 1;
+                return q + n;
+            }
+            q += nacc_;
+            nacc_ = 0;
+            if (q > MAX_UNARY || error()){
+                return 0;
+            }
+        }
+    }
+    bool error() const {
+        // consumed more bits than available?
+        return ((int64_t)pos_ * 8 - nacc_) > ((int64_t)size_ * 8);
+    }
+private:
+    void refill(){
+        while (nacc_ <= 56){
+            acc_ = (acc_ << 8) | (pos_ < size_ ? buf_[pos_] : 0);
+            pos_++;
+            nacc_ += 8;
+        }
+    }
+    const uint8_t *buf_;
+    int32_t size_;
+    int32_t pos_ = 0;
+    uint64_t acc_ = 0;
+    int32_t nacc_ = 0;
+};
+
+/*/////////////////// prediction ////////////////////*/
+
+inline int64_t predict(const int32_t *x, int32_t order){
+    switch (order){
+    case 1:
+        return x[-1];
+    case 2:
+        return 2 * (int64_t)x[-1] - x[-2];
+    case 3:
+        return 3 * ((int64_t)x[-1] - x[-2]) + x[-3];
+    case 4:
+        return 4 * ((int64_t)x[-1] + x[-3]) - 6 * (int64_t)x[-2] - x[-4];
+    default:
+        return 0;
+    }
+}
+
+inline uint32_t zigzag_encode(int32_t r){
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+inline int32_t zigzag_decode(uint32_t u){
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+inline int32_t sign_extend(uint32_t value, int32_t nbits){
+    auto shift = 32 - nbits;
+    return (int32_t)(value << shift) >> shift;
+}
+
+// choose the predictor order with the smallest sum of absolute residuals
+int32_t choose_order(const int32_t *x, int32_t n){
+    uint64_t sum[MAX_ORDER + 1] = { 0 };
+    for (int i = MAX_ORDER; i < n; ++i){
+        int64_t d0 = x[i];
+        int64_t d1 = d0 - x[i - 1];
+        int64_t d2 = d1 - ((int64_t)x[i - 1] - x[i - 2]);
+        int64_t d3 = d2 - ((int64_t)x[i - 1] - 2 * (int64_t)x[i - 2] + x[i - 3]);
+        int64_t d4 = d3 - ((int64_t)x[i - 1] - 3 * ((int64_t)x[i - 2] - x[i - 3]) - x[i - 4]);
+        sum[0] += std::abs(d0);
+        sum[1] += std::abs(d1);
+        sum[2] += std::abs(d2);
+        sum[3] += std::abs(d3);
+        sum[4] += std::abs(d4);
+    }
+    int32_t order = 0;
+    for (int i = 1; i <= MAX_ORDER; ++i){
+        if (sum[i] < sum[order]){
+            order = i;
+        }
+    }
+    return order;
+}
+
+int64_t rice_bits(const uint32_t *u, int32_t n, int32_t k){
+    int64_t bits = (int64_t)n * (k + 1);
+    for (int i = 0; i < n; ++i){
+        bits += u[i] >> k;
+    }
+    return bits;
+}
+
+// find the Rice parameter with the smallest output size
+int32_t choose_rice_param(const uint32_t *u, int32_t n, int64_t& bits){
+    uint64_t sum = 0;
+    for (int i = 0; i < n; ++i){
+        sum += u[i];
+    }
+    // estimate from the mean, then check the neighbors
+    int32_t k = 0;
+    while (k < MAX_RICE_PARAM && ((uint64_t)n << (k + 1)) <= sum){
+        k++;
+    }
+    int32_t best = k;
+    bits = rice_bits(u, n, k);
+    for (int32_t i : { k - 1, k + 1 }){
+        if (i >= 0 && i <= MAX_RICE_PARAM){
+            auto b = rice_bits(u, n, i);
+            if (b < bits){
+                bits = b;
+                best = i;
+            }
+        }
+    }
+    return best;
+}
+
+struct codec {
+    codec(){
+        memset(&format, 0, sizeof(format));
+    }
+    aoo_format_lossless format;
+    std::vector<int32_t> samples;
+    std::vector<uint32_t> residuals;
+};
+
+void print_settings(const aoo_format_lossless& f){
+    LOG_VERBOSE("lossless settings: "
+                << "nchannels = " << f.header.nchannels
+                << ", blocksize = " << f.header.blocksize
+                << ", samplerate = " << f.header.samplerate
+                << ", bitdepth = " << f.bitdepth);
+}
+
+void *encoder_new(){
+    return new codec;
+}
+
+void encoder_free(void *enc){
+    delete (codec *)enc;
+}
+
+void encoder_setup(void *enc, aoo_format *f){
+    assert(!strcmp(f->codec, AOO_CODEC_LOSSLESS));
+    auto c = static_cast<codec *>(enc);
+    auto fmt = reinterpret_cast<aoo_format_lossless *>(f);
+
+    // validate blocksize
+    if (fmt->header.blocksize <= 0){
+        LOG_WARNING("lossless: bad blocksize " << fmt->header.blocksize
+                    << ", using 64 samples");
+        fmt->header.blocksize = 64;
+    }
+    // validate samplerate
+    if (fmt->header.samplerate <= 0){
+        LOG_WARNING("lossless: bad samplerate " << fmt->header.samplerate
+                    << ", using 44100");
+        fmt->header.samplerate = 44100;
+    }
+    // validate channels
+    if (fmt->header.nchannels <= 0 || fmt->header.nchannels > 255){
+        LOG_WARNING("lossless: bad channel count " << fmt->header.nchannels
+                    << ", using 1 channel");
+        fmt->header.nchannels = 1;
+    }
+    // validate bitdepth
+    if (fmt->bitdepth != 16 && fmt->bitdepth != 24){
+        LOG_WARNING("lossless: bad bitdepth, using 24 bit");
+        fmt->bitdepth = 24;
+    }
+
+    c->samples.resize(fmt->header.blocksize);
+    c->residuals.resize(fmt->header.blocksize);
+
+    // save and print settings
+    memcpy(&c->format, fmt, sizeof(aoo_format_lossless));
+    print_settings(c->format);
+}
+
+void encode_channel(codec& c, bit_writer& writer, const aoo_sample *s,
+                    int32_t nchannels, int32_t nframes){
+    auto bitdepth = c.format.bitdepth;
+    auto x = c.samples.data();
+    auto u = c.residuals.data();
+    // convert to integer
+    if (bitdepth == 16){
+        for (int i = 0; i < nframes; ++i){
+            x[i] = sample_to_int16(s[i * nchannels]);
+        }
+    } else {
+        for (int i = 0; i < nframes; ++i){
+            x[i] = sample_to_int24(s[i * nchannels]);
+        }
+    }
+    // check for constant signal (e.g. silence)
+    bool constant = true;
+    for (int i = 1; i < nframes; ++i){
+        if (x[i] != x[0]){
+            constant = false;
+            break;
+        }
+    }
+    if (constant){
+        writer.write(MODE_CONSTANT << 5, 8);
+        writer.write(x[0], bitdepth);
+        return;
+    }
+    // try fixed predictor
+    int64_t verbatim_bits = (int64_t)nframes * bitdepth;
+    if (nframes > MAX_ORDER){
+        auto order = choose_order(x, nframes);
+        auto n = nframes - order;
+        for (int i = 0; i < n; ++i){
+            auto j = i + order;
+            u[i] = zigzag_encode(x[j] - (int32_t)predict(x + j, order));
+        }
+        int64_t bits;
+        auto k = choose_rice_param(u, n, bits);
+        if ((bits + order * bitdepth) < verbatim_bits){
+            writer.write((order << 5) | k, 8);
+            // warm-up samples
+            for (int i = 0; i < order; ++i){
+                writer.write(x[i], bitdepth);
+            }
+            // residuals
+            for (int i = 0; i < n; ++i){
+                writer.write_unary(u[i] >> k);
+                writer.write(u[i], k);
+            }
+            return;
+        }
+    }
+    // verbatim
+    writer.write(MODE_VERBATIM << 5, 8);
+    for (int i = 0; i < nframes; ++i){
+        writer.write(x[i], bitdepth);
+    }
+}
+
+int32_t encoder_encode(void *enc,
+                       const aoo_sample *s, int32_t n,
+                       char *buf, int32_t size)
+{
+    auto c = static_cast<codec *>(enc);
+    auto nchannels = c->format.header.nchannels;
+    auto nframes = n / nchannels;
+    if (nframes > (int32_t)c->samples.size()){
+        c->samples.resize(nframes);
+        c->residuals.resize(nframes);
+    }
+
+    bit_writer writer(buf, size);
+    for (int i = 0; i < nchannels; ++i){
+        encode_channel(*c, writer, s + i, nchannels, nframes);
+    }
+    auto result = writer.finish();
+    if (writer.overflow()){
+        LOG_ERROR("lossless: buffer too small!");
+        return 0;
+    }
+    return result;
+}
+
+int32_t encoder_write(void *enc, int32_t *nchannels, int32_t *samplerate,
+                      int32_t *blocksize, char *buf, int32_t size){
+    if (size >= 4){
+        auto c = static_cast<codec *>(enc);
+        *nchannels = c->format.header.nchannels;
+        *samplerate = c->format.header.samplerate;
+        *blocksize = c->format.header.blocksize;
+        aoo::to_bytes<int32_t>(c->format.bitdepth, buf);
+
+        return 4;
+    } else {
+        LOG_ERROR("lossless: couldn't write settings - buffer too small!");
+        return -1;
+    }
+}
+
+void *decoder_new(){
+    return new codec;
+}
+
+void decoder_free(void *dec){
+    delete (codec *)dec;
+}
+
+bool decode_channel(codec& c, bit_reader& reader, aoo_sample *s,
+                    int32_t nchannels, int32_t nframes){
+    auto bitdepth = c.format.bitdepth;
+    auto x = c.samples.data();
+
+    auto header = reader.read(8);
+    auto mode = header >> 5;
+    auto k = header & 31;
+    if (mode <= MAX_ORDER){
+        int32_t order = mode;
+        if (order >= nframes){
+            return false;
+        }
+        // warm-up samples
+        for (int i = 0; i < order; ++i){
+            x[i] = sign_extend(reader.read(bitdepth), bitdepth);
+        }
+        // residuals
+        for (int i = order; i < nframes; ++i){
+            auto q = reader.read_unary();
+            auto u = (q << k) | reader.read(k);
+            x[i] = (int32_t)(zigzag_decode(u) + predict(x + i, order));
+        }
+    } else if (mode == MODE_CONSTANT){
+        auto value = sign_extend(reader.read(bitdepth), bitdepth);
+        std::fill(x, x + nframes, value);
+    } else if (mode == MODE_VERBATIM){
+        for (int i = 0; i < nframes; ++i){
+            x[i] = sign_extend(reader.read(bitdepth), bitdepth);
+        }
+    } else {
+        return false;
+    }
+    if (reader.error()){
+        return false;
+    }
+    // convert to float
+    if (bitdepth == 16){
+        for (int i = 0; i < nframes; ++i){
+            s[i * nchannels] = int16_to_sample(x[i]);
+        }
+    } else {
+        for (int i = 0; i < nframes; ++i){
+            s[i * nchannels] = int24_to_sample(x[i]);
+        }
+    }
+    return true;
+}
+
+int32_t decoder_decode(void *dec,
+                       const char *buf, int32_t size,
+                       aoo_sample *s, int32_t n)
+{
+    auto c = static_cast<codec *>(dec);
+    assert(c->format.header.blocksize != 0);
+
+    auto nchannels = c->format.header.nchannels;
+    auto nframes = n / nchannels;
+    if (nframes > (int32_t)c->samples.size()){
+        c->samples.resize(nframes);
+    }
+
+    bit_reader reader(buf, size);
+    for (int i = 0; i < nchannels; ++i){
+        if (!decode_channel(*c, reader, s + i, nchannels, nframes)){
+            LOG_VERBOSE("lossless: corrupt data");
+            return 0;
+        }
+    }
+    return nframes * nchannels;
+}
+
+int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
+                     int32_t blocksize, const char *buf, int32_t size){
+    if (size >= 4){
+        auto c = static_cast<codec *>(dec);
+        auto bitdepth = aoo::from_bytes<int32_t>(buf);
+        if (bitdepth != 16 && bitdepth != 24){
+            LOG_ERROR("lossless: bad bitdepth " << bitdepth);
+            return -1;
+        }
+        if (nchannels <= 0 || blocksize <= 0){
+            LOG_ERROR("lossless: bad format");
+            return -1;
+        }
+        c->format.header.nchannels = nchannels;
+        c->format.header.samplerate = samplerate;
+        c->format.header.blocksize = blocksize;
+        c->format.bitdepth = bitdepth;
+        c->samples.resize(blocksize);
+        print_settings(c->format);
+        return 4;
+    } else {
+        LOG_ERROR("lossless: couldn't read settings - not enough data!");
+    }
+    return -1;
+}
+
+aoo_codec codec_class = {
+    AOO_CODEC_LOSSLESS,
+    AOO_CODEC_LOSSLESS_ID,
+    encoder_new,
+    encoder_free,
+    encoder_setup,
+    encoder_encode,
+    encoder_write,
+    decoder_new,
+    decoder_free,
+    decoder_decode,
+    decoder_read,
+    nullptr // no recovery
+};
+
+} // namespace
+
+void aoo_codec_lossless_setup(aoo_codec_registerfn fn){
+    fn(AOO_CODEC_LOSSLESS, &codec_class);
+}
@@ -4,30 +4,85 @@
 #include <cassert>
 #include <cstring>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 namespace {
 
+// we always use the multistream API. with 1 or 2 channels there is only
+// a single stream and the packets are identical to plain Opus packets.
+// for more channels, each channel is coded as a separate mono stream
+// (mapping family 255), because the channels are not necessarily
+// related (e.g. speaker feeds). LATER allow surround mappings.
+struct stream_config {
+    int32_t streams = 0;
+    int32_t coupled_streams = 0;
+    unsigned char mapping[255];
+};
+
+#define AOO_OPUS_SETTINGSIZE 12
+
+// blocks longer than 60 ms are coded as a sequence of Opus packets with
+// 20 ms frames, each prefixed with its size (2 bytes). with a single stream,
+// consecutive frames are merged with the repacketizer (up to 120 ms).
+#define AOO_OPUS_MAXPACKETSIZE 1275 // per frame and stream
+#define AOO_OPUS_MAXREPACKETIZE 6 // 6 * 20 ms = 120 ms
+#define AOO_OPUS_MAXFRAMES 50 // 1 second
+
+int32_t max_blocksize(int32_t samplerate){
+    return samplerate / 400 * 24; // 2880 samples @ 48 kHz
+}
+
+int32_t chunk_framesize(int32_t samplerate){
+    return samplerate / 50; // 20 ms
+}
+
+int32_t stream_config_size(int32_t nchannels){
+    return 8 + nchannels;
+}
+
+void default_stream_config(stream_config& c, int32_t nchannels){
+    if (nchannels <= 2){
+        c.streams = 1;
+        c.coupled_streams = nchannels - 1;
+    } else {
+        c.streams = nchannels;
+        c.coupled_streams = 0;
+    }
+    for (int i = 0; i < nchannels; ++i){
+        c.mapping[i] = i;
+    }
+}
+
 struct encoder {
     encoder(){
         memset(&format, 0, sizeof(format));
     }
     ~encoder(){
         if (state){
-            opus_encoder_destroy(state);
+            opus_multistream_encoder_destroy(state);
+        }
+        if (repacketizer){
+            opus_repacketizer_destroy(repacketizer);
         }
     }
-    OpusEncoder *state = nullptr;
+    OpusMSEncoder *state = nullptr;
+    // for long blocks
+    OpusRepacketizer *repacketizer = nullptr;
+    std::vector<unsigned char> scratch;
     aoo_format_opus format;
+    stream_config config;
 };
 
 struct decoder {
     ~decoder(){
         if (state){
-            opus_decoder_destroy(state);
+            opus_multistream_decoder_destroy(state);
         }
     }
-    OpusDecoder * state = nullptr;
+    OpusMSDecoder * state = nullptr;
     aoo_format_opus format;
+    stream_config config;
 };
 
 void print_settings(const aoo_format_opus& f){
@@ -50,7 +105,15 @@ void print_settings(const aoo_format_opus& f){
                 << ", samplerate = " << f.header.samplerate
                 << ", bitrate = " << f.bitrate
                 << ", complexity = " << f.complexity
-                << ", signal type = " << type);
+                << ", signal type = " << type
+                << ", fec = " << f.fec
+                << ", packet loss = " << f.packet_loss << "%"
+                << ", dtx = " << f.dtx);
+}
+
+void print_stream_config(const stream_config& c){
+    LOG_VERBOSE("Opus: streams = " << c.streams
+                << ", coupled streams = " << c.coupled_streams);
 }
 
 void *encoder_new(){
@@ -80,20 +143,24 @@ void encoder_setup(void *enc, aoo_format *f){
         fmt->header.samplerate = 48000;
         break;
     }
-    // validate channels (LATER support multichannel!)
-    if (fmt->header.nchannels < 1 || fmt->header.nchannels > 2){
+    // validate channels
+    if (fmt->header.nchannels < 1 || fmt->header.nchannels > 255){
         LOG_WARNING("Opus: channel count " << fmt->header.nchannels <<
                     " out of range - using 1 channels");
         fmt->header.nchannels = 1;
     }
     // validate blocksize
     int minblocksize = fmt->header.samplerate / 400; // 120 samples @ 48 kHz
-    int maxblocksize = minblocksize * 24; // 2880 samples @ 48 kHz
+    int maxblocksize = max_blocksize(fmt->header.samplerate);
     int blocksize = fmt->header.blocksize;
     if (blocksize < minblocksize){
         fmt->header.blocksize = minblocksize;
     } else if (blocksize > maxblocksize){
-        fmt->header.blocksize = maxblocksize;
+        // round to a multiple of 20 ms (at least 80 ms)
+        int framesize = chunk_framesize(fmt->header.samplerate);
+        int nframes = (blocksize + framesize / 2) / framesize;
+        nframes = std::max<int>(4, std::min<int>(nframes, AOO_OPUS_MAXFRAMES));
+        fmt->header.blocksize = nframes * framesize;
     } else {
         // round down
         while (blocksize > (minblocksize * 2)){
@@ -103,33 +170,149 @@ void encoder_setup(void *enc, aoo_format *f){
     }
     // bitrate, complexity and signal type should be validated by opus
 
-    int error = 0;
-    if (c->state){
-        opus_encoder_destroy(c->state);
+    // only recreate the encoder if the samplerate or channel count has changed,
+    // otherwise we just update the settings. this keeps the encoder state
+    // (no audible gap) and avoids allocating memory.
+    if (!c->state || fmt->header.samplerate != c->format.header.samplerate
+            || fmt->header.nchannels != c->format.header.nchannels){
+        if (c->state){
+            opus_multistream_encoder_destroy(c->state);
+        }
+        int error = 0;
+        default_stream_config(c->config, fmt->header.nchannels);
+        c->state = opus_multistream_encoder_create(fmt->header.samplerate,
+                                                   fmt->header.nchannels,
+                                                   c->config.streams,
+                                                   c->config.coupled_streams,
+                                                   c->config.mapping,
+                                                   OPUS_APPLICATION_AUDIO,
+                                                   &error);
+        if (error != OPUS_OK){
+            LOG_ERROR("Opus: opus_multistream_encoder_create() failed with error code " << error);
+            c->state = nullptr;
+        }
     }
-    c->state = opus_encoder_create(fmt->header.samplerate,
-                                       fmt->header.nchannels,
-                                       OPUS_APPLICATION_AUDIO,
-                                       &error);
-    if (error == OPUS_OK){
-        assert(c->state != nullptr);
+    if (c->state){
         // apply settings
         // complexity
-        opus_encoder_ctl(c->state, OPUS_SET_COMPLEXITY(fmt->complexity));
-        opus_encoder_ctl(c->state, OPUS_GET_COMPLEXITY(&fmt->complexity));
-        // bitrate
-        opus_encoder_ctl(c->state, OPUS_SET_BITRATE(fmt->bitrate));
-        opus_encoder_ctl(c->state, OPUS_GET_BITRATE(&fmt->bitrate));
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_COMPLEXITY(fmt->complexity));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_COMPLEXITY(&fmt->complexity));
+        // bitrate (for all streams)
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_BITRATE(fmt->bitrate));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_BITRATE(&fmt->bitrate));
         // signal type
-        opus_encoder_ctl(c->state, OPUS_SET_SIGNAL(fmt->signal_type));
-        opus_encoder_ctl(c->state, OPUS_GET_SIGNAL(&fmt->signal_type));
-    } else {
-        LOG_ERROR("Opus: opus_encoder_create() failed with error code " << error);
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_SIGNAL(fmt->signal_type));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_SIGNAL(&fmt->signal_type));
+        // in-band FEC
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_INBAND_FEC(fmt->fec));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_INBAND_FEC(&fmt->fec));
+        // expected packet loss
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_PACKET_LOSS_PERC(fmt->packet_loss));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_PACKET_LOSS_PERC(&fmt->packet_loss));
+        // DTX
+        opus_multistream_encoder_ctl(c->state, OPUS_SET_DTX(fmt->dtx));
+        opus_multistream_encoder_ctl(c->state, OPUS_GET_DTX(&fmt->dtx));
+    }
+
+    // long blocks with a single stream
+    if (fmt->header.blocksize > maxblocksize && c->config.streams == 1){
+        if (!c->repacketizer){
+            c->repacketizer = opus_repacketizer_create();
+        }
+        c->scratch.resize(AOO_OPUS_MAXPACKETSIZE * AOO_OPUS_MAXREPACKETIZE);
+    } else if (c->repacketizer){
+        // not needed anymore (e.g. multistream)
+        opus_repacketizer_destroy(c->repacketizer);
+        c->repacketizer = nullptr;
     }
 
     // save and print settings
     memcpy(&c->format, fmt, sizeof(aoo_format_opus));
     print_settings(*fmt);
+    print_stream_config(c->config);
+}
+
+int32_t encode_long_block(encoder& c, const aoo_sample *s, int32_t n,
+                          char *buf, int32_t size)
+{
+    auto nchannels = c.format.header.nchannels;
+    auto framesize = chunk_framesize(c.format.header.samplerate);
+    auto nframes = n / nchannels / framesize;
+    int32_t offset = 0;
+
+    if (c.config.streams != 1 || !c.repacketizer){
+        // multistream packets can't be repacketized, so we write each frame
+        for (int i = 0; i < nframes; ++i){
+            auto maxsize = std::min<int32_t>(size - offset - 2, 0xffff);
+            if (maxsize <= 0){
+                LOG_ERROR("Opus: buffer too small!");
+                return 0;
+            }
+            auto result = opus_multistream_encode_float(c.state, s + i * framesize * nchannels, framesize,
+                                                        (unsigned char *)buf + offset + 2, maxsize);
+            if (result <= 0){
+                LOG_VERBOSE("Opus: opus_multistream_encode_float() failed with error code " << result);
+                return 0;
+            }
+            aoo::to_bytes<uint16_t>(result, buf + offset);
+            offset += result + 2;
+        }
+        return offset;
+    }
+
+    // merge the frames with the repacketizer
+    auto rp = c.repacketizer;
+    int32_t count = 0;
+    int32_t pos = 0;
+    auto flush = [&](){
+        if (count > 0){
+            auto result = opus_repacketizer_out(rp, (unsigned char *)buf + offset + 2,
+                                                std::min<int32_t>(size - offset - 2, 0xffff));
+            if (result <= 0){
+                LOG_ERROR("Opus: opus_repacketizer_out() failed with error code " << result);
+                return false;
+            }
+            aoo::to_bytes<uint16_t>(result, buf + offset);
+            offset += result + 2;
+            opus_repacketizer_init(rp);
+            count = 0;
+            pos = 0;
+        }
+        return true;
+    };
+    opus_repacketizer_init(rp);
+    for (int i = 0; i < nframes; ++i){
+        auto data = c.scratch.data() + pos;
+        auto result = opus_multistream_encode_float(c.state, s + i * framesize * nchannels, framesize,
+                                                    data, AOO_OPUS_MAXPACKETSIZE);
+        if (result <= 0){
+            LOG_VERBOSE("Opus: opus_multistream_encode_float() failed with error code " << result);
+            return 0;
+        }
+        if (opus_repacketizer_cat(rp, data, result) != OPUS_OK){
+            // the frame has a different configuration (e.g. the encoder
+            // switched modes), so we have to start a new packet.
+            if (!flush()){
+                return 0;
+            }
+            memmove(c.scratch.data(), data, result);
+            data = c.scratch.data();
+            if (opus_repacketizer_cat(rp, data, result) != OPUS_OK){
+                LOG_ERROR("Opus: opus_repacketizer_cat() failed");
+                return 0;
+            }
+        }
+        pos += result;
+        if (++count == AOO_OPUS_MAXREPACKETIZE){
+            if (!flush()){
+                return 0;
+            }
+        }
+    }
+    if (!flush()){
+        return 0;
+    }
+    return offset;
 }
 
 int32_t encoder_encode(void *enc,
@@ -139,29 +322,40 @@ int32_t encoder_encode(void *enc,
     auto c = static_cast<encoder *>(enc);
     if (c->state){
         auto framesize = n / c->format.header.nchannels;
-        auto result = opus_encode_float(c->state,
-                                        s, framesize, (unsigned char *)buf, size);
+        if (framesize > max_blocksize(c->format.header.samplerate)){
+            return encode_long_block(*c, s, n, buf, size);
+        }
+        auto result = opus_multistream_encode_float(c->state,
+                                                    s, framesize, (unsigned char *)buf, size);
         if (result > 0){
             return result;
         } else {
-            LOG_VERBOSE("Opus: opus_encode_float() failed with error code " << result);
+            LOG_VERBOSE("Opus: opus_multistream_encode_float() failed with error code " << result);
         }
     }
     return 0;
 }
 
+// settings: <bitrate> <complexity> <signal_type> [<streams> <coupled_streams> <mapping...>]
+// the stream configuration is optional for 1 or 2 channels (backwards compatibility)
+
 int32_t encoder_write(void *enc, int32_t *nchannels,int32_t *samplerate,
                       int32_t *blocksize, char *buf, int32_t size){
-    if (size >= 12){
-        auto c = static_cast<encoder *>(enc);
+    auto c = static_cast<encoder *>(enc);
+    auto totalsize = AOO_OPUS_SETTINGSIZE + stream_config_size(c->format.header.nchannels);
+    if (size >= totalsize){
         *nchannels = c->format.header.nchannels;
         *samplerate = c->format.header.samplerate;
         *blocksize = c->format.header.blocksize;
         aoo::to_bytes<int32_t>(c->format.bitrate, buf);
         aoo::to_bytes<int32_t>(c->format.complexity, buf + 4);
         aoo::to_bytes<int32_t>(c->format.signal_type, buf + 8);
+        // stream configuration
+        aoo::to_bytes<int32_t>(c->config.streams, buf + 12);
+        aoo::to_bytes<int32_t>(c->config.coupled_streams, buf + 16);
+        memcpy(buf + 20, c->config.mapping, c->format.header.nchannels);
 
-        return 12;
+        return totalsize;
     } else {
         LOG_WARNING("Opus: couldn't write settings");
         return -1;
@@ -176,6 +370,76 @@ void decoder_free(void *dec){
     delete (decoder *)dec;
 }
 
+// decode a sequence of Opus packets (see encode_long_block)
+int32_t decode_long_block(decoder& c, const char *buf, int32_t size,
+                          aoo_sample *s, int32_t n)
+{
+    auto nchannels = c.format.header.nchannels;
+    auto framesize = n / nchannels;
+    int32_t onset = 0;
+    int32_t offset = 0;
+    while (offset < size && onset < framesize){
+        if (offset + 2 > size){
+            break;
+        }
+        auto len = aoo::from_bytes<uint16_t>(buf + offset);
+        if (offset + 2 + len > size){
+            break;
+        }
+        auto result = opus_multistream_decode_float(c.state, (const unsigned char *)buf + offset + 2, len,
+                                                    s + onset * nchannels, framesize - onset, 0);
+        if (result <= 0){
+            LOG_VERBOSE("Opus: opus_multistream_decode_float() failed with error code " << result);
+            return 0;
+        }
+        onset += result;
+        offset += len + 2;
+    }
+    if (onset != framesize){
+        LOG_VERBOSE("Opus: corrupt data");
+        return 0;
+    }
+    return framesize;
+}
+
+// conceal all frames of a long block but the last one,
+// which can be recovered from the following block.
+int32_t recover_long_block(decoder& c, const char *buf, int32_t size,
+                           aoo_sample *s, int32_t n)
+{
+    auto nchannels = c.format.header.nchannels;
+    auto framesize = n / nchannels;
+    auto chunksize = chunk_framesize(c.format.header.samplerate);
+    int32_t onset = 0;
+    while (framesize - onset > chunksize){
+        auto result = opus_multistream_decode_float(c.state, nullptr, 0,
+                                                    s + onset * nchannels, chunksize, 0);
+        if (result <= 0){
+            LOG_VERBOSE("Opus: opus_multistream_decode_float() failed with error code " << result);
+            return 0;
+        }
+        onset += result;
+    }
+    // the first packet of the following block
+    const unsigned char *data = nullptr;
+    int32_t len = 0;
+    if (buf && size >= 2){
+        len = aoo::from_bytes<uint16_t>(buf);
+        if (len + 2 <= size){
+            data = (const unsigned char *)buf + 2;
+        } else {
+            len = 0;
+        }
+    }
+    auto result = opus_multistream_decode_float(c.state, data, len, s + onset * nchannels,
+                                                framesize - onset, data != nullptr);
+    if (result <= 0){
+        LOG_VERBOSE("Opus: opus_multistream_decode_float() failed with error code " << result);
+        return 0;
+    }
+    return framesize;
+}
+
 int32_t decoder_decode(void *dec,
                        const char *buf, int32_t size,
                        aoo_sample *s, int32_t n)
@@ -183,11 +447,38 @@ int32_t decoder_decode(void *dec,
     auto c = static_cast<decoder *>(dec);
     if (c->state){
         auto framesize = n / c->format.header.nchannels;
-        auto result = opus_decode_float(c->state, (const unsigned char *)buf, size, s, framesize, 0);
+        if (framesize > max_blocksize(c->format.header.samplerate)){
+            return decode_long_block(*c, buf, size, s, n);
+        }
+        auto result = opus_multistream_decode_float(c->state, (const unsigned char *)buf, size,
+                                                    s, framesize, 0);
+        if (result > 0){
+            return result;
+        } else {
+            LOG_VERBOSE("Opus: opus_multistream_decode_float() failed with error code " << result);
+        }
+    }
+    return 0;
+}
+
+int32_t decoder_recover(void *dec,
+                        const char *buf, int32_t size,
+                        aoo_sample *s, int32_t n)
+{
+    auto c = static_cast<decoder *>(dec);
+    if (c->state){
+        auto framesize = n / c->format.header.nchannels;
+        if (framesize > max_blocksize(c->format.header.samplerate)){
+            return recover_long_block(*c, buf, size, s, n);
+        }
+        // decode the FEC data of the following packet (if available),
+        // otherwise Opus does packet loss concealment.
+        auto result = opus_multistream_decode_float(c->state, (const unsigned char *)buf, size,
+                                                    s, framesize, buf != nullptr);
         if (result > 0){
             return result;
         } else {
-            LOG_VERBOSE("Opus: opus_decode_float() failed with error code " << result);
+            LOG_VERBOSE("Opus: opus_multistream_decode_float() failed with error code " << result);
         }
     }
     return 0;
@@ -195,43 +486,72 @@ int32_t decoder_decode(void *dec,
 
 int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
                      int32_t blocksize, const char *buf, int32_t size){
-    if (size >= 12){
+    if (size >= AOO_OPUS_SETTINGSIZE){
         auto c = static_cast<decoder *>(dec);
+        if (nchannels < 1 || nchannels > 255){
+            LOG_ERROR("Opus: bad channel count " << nchannels);
+            return -1;
+        }
+        // stream configuration
+        stream_config config;
+        int32_t nbytes = AOO_OPUS_SETTINGSIZE;
+        if (size >= AOO_OPUS_SETTINGSIZE + stream_config_size(nchannels)){
+            config.streams = aoo::from_bytes<int32_t>(buf + 12);
+            config.coupled_streams = aoo::from_bytes<int32_t>(buf + 16);
+            memcpy(config.mapping, buf + 20, nchannels);
+            nbytes += stream_config_size(nchannels);
+        } else if (nchannels <= 2){
+            // older sources don't send a stream configuration
+            default_stream_config(config, nchannels);
+        } else {
+            LOG_ERROR("Opus: missing stream configuration for "
+                      << nchannels << " channels");
+            return -1;
+        }
+
+        // only recreate the decoder if the samplerate or stream configuration
+        // has changed. the other settings only concern the encoder.
+        bool changed = !c->state || samplerate != c->format.header.samplerate
+                || nchannels != c->format.header.nchannels
+                || config.streams != c->config.streams
+                || config.coupled_streams != c->config.coupled_streams
+                || memcmp(config.mapping, c->config.mapping, nchannels);
+
         c->format.header.nchannels = nchannels;
         c->format.header.samplerate = samplerate;
         c->format.header.blocksize = blocksize;
         c->format.bitrate = aoo::from_bytes<int32_t>(buf);
         c->format.complexity = aoo::from_bytes<int32_t>(buf + 4);
         c->format.signal_type = aoo::from_bytes<int32_t>(buf + 8);
+        c->config = config;
 
-        // TODO validate format
-
-        if (c->state){
-            opus_decoder_destroy(c->state);
-        }
-        int error = 0;
-        c->state = opus_decoder_create(c->format.header.samplerate,
-                                           c->format.header.nchannels,
-                                           &error);
-        if (error == OPUS_OK){
-            assert(c->state != nullptr);
-            // apply settings
-            // complexity
-            opus_decoder_ctl(c->state, OPUS_SET_COMPLEXITY(c->format.complexity));
-            opus_decoder_ctl(c->state, OPUS_GET_COMPLEXITY(&c->format.complexity));
-            // bitrate
-            opus_decoder_ctl(c->state, OPUS_SET_BITRATE(c->format.bitrate));
-            opus_decoder_ctl(c->state, OPUS_GET_BITRATE(&c->format.bitrate));
-            // signal type
-            opus_decoder_ctl(c->state, OPUS_SET_SIGNAL(c->format.signal_type));
-            opus_decoder_ctl(c->state, OPUS_GET_SIGNAL(&c->format.signal_type));
+        if (changed){
+            // the multistream decoder validates the stream configuration
+            if (c->state){
+                opus_multistream_decoder_destroy(c->state);
+            }
+            int error = 0;
+            c->state = opus_multistream_decoder_create(c->format.header.samplerate,
+                                                       c->format.header.nchannels,
+                                                       c->config.streams,
+                                                       c->config.coupled_streams,
+                                                       c->config.mapping,
+                                                       &error);
+            if (error == OPUS_OK){
+                assert(c->state != nullptr);
+            } else {
+                LOG_ERROR("Opus: opus_multistream_decoder_create() failed with error code " << error);
+                c->state = nullptr;
+            }
         } else {
-            LOG_ERROR("Opus: opus_decoder_create() failed with error code " << error);
+            // a new stream (or a pooled decoder): don't carry over the old state
+            opus_multistream_decoder_ctl(c->state, OPUS_RESET_STATE);
         }
 
         print_settings(c->format);
+        print_stream_config(c->config);
 
-        return 12;
+        return nbytes;
     } else {
         LOG_ERROR("Opus: couldn't read settings - too little data!");
         return -1;
@@ -240,6 +560,7 @@ int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
 
 aoo_codec codec_class = {
     AOO_CODEC_OPUS,
+    AOO_CODEC_OPUS_ID,
     encoder_new,
     encoder_free,
     encoder_setup,
@@ -248,7 +569,8 @@ aoo_codec codec_class = {
     decoder_new,
     decoder_free,
     decoder_decode,
-    decoder_read
+    decoder_read,
+    decoder_recover
 };
 
 } // namespace
@@ -0,0 +1,419 @@
+#include "aoo/aoo_opus_custom.h"
+
+#if AOO_OPUS_CUSTOM
+
+#include "aoo/aoo_utils.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// like the Opus codec, we use a single stream for 1 or 2 channels.
+// for more channels, each channel is coded as a separate mono stream
+// because the channels are not necessarily related.
+// with several streams, each stream packet is prefixed with its size (2 bytes).
+int32_t num_streams(int32_t nchannels){
+    return nchannels <= 2 ? 1 : nchannels;
+}
+
+int32_t stream_channels(int32_t nchannels){
+    return nchannels <= 2 ? nchannels : 1;
+}
+
+#define AOO_OPUS_CUSTOM_SETTINGSIZE 8
+#define AOO_OPUS_CUSTOM_MINFRAMESIZE 64
+#define AOO_OPUS_CUSTOM_MAXFRAMESIZE 1024
+#define AOO_OPUS_CUSTOM_MAXPACKETSIZE 1275
+#define AOO_OPUS_CUSTOM_DEFBITRATE 64000 // per channel
+
+struct encoder {
+    encoder(){
+        memset(&format, 0, sizeof(format));
+    }
+    ~encoder(){
+        destroy();
+    }
+    void destroy(){
+        for (auto& s : streams){
+            opus_custom_encoder_destroy(s);
+        }
+        streams.clear();
+        // the mode must be destroyed last!
+        if (mode){
+            opus_custom_mode_destroy(mode);
+            mode = nullptr;
+        }
+    }
+    OpusCustomMode *mode = nullptr;
+    std::vector<OpusCustomEncoder *> streams;
+    std::vector<float> buffer;
+    aoo_format_opus_custom format;
+};
+
+struct decoder {
+    decoder(){
+        memset(&format, 0, sizeof(format));
+    }
+    ~decoder(){
+        destroy();
+    }
+    void destroy(){
+        for (auto& s : streams){
+            opus_custom_decoder_destroy(s);
+        }
+        streams.clear();
+        // the mode must be destroyed last!
+        if (mode){
+            opus_custom_mode_destroy(mode);
+            mode = nullptr;
+        }
+    }
+    OpusCustomMode *mode = nullptr;
+    std::vector<OpusCustomDecoder *> streams;
+    std::vector<float> buffer;
+    aoo_format_opus_custom format;
+};
+
+void print_settings(const aoo_format_opus_custom& f){
+    LOG_VERBOSE("Opus Custom settings: "
+                << "nchannels = " << f.header.nchannels
+                << ", blocksize = " << f.header.blocksize
+                << ", samplerate = " << f.header.samplerate
+                << ", bitrate = " << f.bitrate
+                << ", complexity = " << f.complexity);
+}
+
+// the frame size must be even and its prime factors can only be 2, 3 or 5
+bool check_framesize(int32_t n){
+    if (n & 1){
+        return false;
+    }
+    for (int f : { 2, 3, 5 }){
+        while (n % f == 0){
+            n /= f;
+        }
+    }
+    return n == 1;
+}
+
+void *encoder_new(){
+    return new encoder;
+}
+
+void encoder_free(void *enc){
+    delete (encoder *)enc;
+}
+
+void encoder_setup(void *enc, aoo_format *f){
+    assert(!strcmp(f->codec, AOO_CODEC_OPUS_CUSTOM));
+    auto c = static_cast<encoder *>(enc);
+    auto fmt = reinterpret_cast<aoo_format_opus_custom *>(f);
+
+    // validate samplerate
+    if (fmt->header.samplerate < 8000 || fmt->header.samplerate > 96000){
+        LOG_VERBOSE("Opus Custom: samplerate " << fmt->header.samplerate
+                    << " not supported - using 48000");
+        fmt->header.samplerate = 48000;
+    }
+    // validate channels
+    if (fmt->header.nchannels < 1 || fmt->header.nchannels > 255){
+        LOG_WARNING("Opus Custom: channel count " << fmt->header.nchannels <<
+                    " out of range - using 1 channels");
+        fmt->header.nchannels = 1;
+    }
+    // validate blocksize (frames must not be shorter than 1 ms)
+    int minblocksize = std::max<int>(AOO_OPUS_CUSTOM_MINFRAMESIZE,
+                                     (fmt->header.samplerate + 999) / 1000);
+    int blocksize = fmt->header.blocksize;
+    if (blocksize < minblocksize){
+        blocksize = minblocksize;
+    } else if (blocksize > AOO_OPUS_CUSTOM_MAXFRAMESIZE){
+        blocksize = AOO_OPUS_CUSTOM_MAXFRAMESIZE;
+    }
+    while (!check_framesize(blocksize)){
+        blocksize++;
+    }
+    if (blocksize != fmt->header.blocksize){
+        LOG_VERBOSE("Opus Custom: blocksize " << fmt->header.blocksize
+                    << " not supported - using " << blocksize);
+        fmt->header.blocksize = blocksize;
+    }
+
+    // only recreate the encoder if the samplerate, blocksize or channel count
+    // has changed, otherwise we just update the settings.
+    if (!c->mode || fmt->header.samplerate != c->format.header.samplerate
+            || fmt->header.blocksize != c->format.header.blocksize
+            || fmt->header.nchannels != c->format.header.nchannels){
+        c->destroy();
+        int error = 0;
+        c->mode = opus_custom_mode_create(fmt->header.samplerate,
+                                          fmt->header.blocksize, &error);
+        if (error == OPUS_OK){
+            auto nstreams = num_streams(fmt->header.nchannels);
+            auto nchannels = stream_channels(fmt->header.nchannels);
+            for (int i = 0; i < nstreams; ++i){
+                auto state = opus_custom_encoder_create(c->mode, nchannels, &error);
+                if (error == OPUS_OK){
+                    c->streams.push_back(state);
+                } else {
+                    LOG_ERROR("Opus Custom: opus_custom_encoder_create() failed with error code " << error);
+                    c->destroy();
+                    break;
+                }
+            }
+            c->buffer.resize(fmt->header.blocksize);
+        } else {
+            LOG_ERROR("Opus Custom: opus_custom_mode_create() failed with error code " << error);
+            c->mode = nullptr;
+        }
+    }
+    // apply settings
+    // bitrate (distributed over all streams)
+    if (fmt->bitrate <= 0){
+        fmt->bitrate = AOO_OPUS_CUSTOM_DEFBITRATE * fmt->header.nchannels;
+    }
+    // complexity
+    if (fmt->complexity < 0 || fmt->complexity > 10){
+        fmt->complexity = 10;
+    }
+    for (auto& s : c->streams){
+        auto bitrate = (int64_t)fmt->bitrate * stream_channels(fmt->header.nchannels)
+                / fmt->header.nchannels;
+        opus_custom_encoder_ctl(s, OPUS_SET_BITRATE((opus_int32)bitrate));
+        opus_custom_encoder_ctl(s, OPUS_SET_COMPLEXITY(fmt->complexity));
+    }
+
+    // save and print settings
+    memcpy(&c->format, fmt, sizeof(aoo_format_opus_custom));
+    print_settings(*fmt);
+}
+
+int32_t encoder_encode(void *enc,
+                       const aoo_sample *s, int32_t n,
+                       char *buf, int32_t size)
+{
+    auto c = static_cast<encoder *>(enc);
+    if (c->streams.empty()){
+        return 0;
+    }
+    auto nchannels = c->format.header.nchannels;
+    auto framesize = n / nchannels;
+    if (framesize != c->format.header.blocksize){
+        LOG_ERROR("Opus Custom: wrong number of samples");
+        return 0;
+    }
+    if (c->streams.size() == 1){
+        auto result = opus_custom_encode_float(c->streams[0], s, framesize, (unsigned char *)buf,
+                                               std::min<int32_t>(size, AOO_OPUS_CUSTOM_MAXPACKETSIZE));
+        if (result > 0){
+            return result;
+        } else {
+            LOG_VERBOSE("Opus Custom: opus_custom_encode_float() failed with error code " << result);
+            return 0;
+        }
+    }
+    // one mono stream per channel
+    int32_t offset = 0;
+    for (int i = 0; i < nchannels; ++i){
+        auto maxsize = std::min<int32_t>(size - offset - 2, AOO_OPUS_CUSTOM_MAXPACKETSIZE);
+        if (maxsize <= 0){
+            LOG_ERROR("Opus Custom: buffer too small!");
+            return 0;
+        }
+        auto buffer = c->buffer.data();
+        for (int j = 0; j < framesize; ++j){
+            buffer[j] = s[j * nchannels + i];
+        }
+        auto result = opus_custom_encode_float(c->streams[i], buffer, framesize,
+                                               (unsigned char *)buf + offset + 2, maxsize);
+        if (result > 0){
+            aoo::to_bytes<int16_t>(result, buf + offset);
+            offset += result + 2;
+        } else {
+            LOG_VERBOSE("Opus Custom: opus_custom_encode_float() failed with error code " << result);
+            return 0;
+        }
+    }
+    return offset;
+}
+
+// settings: <bitrate> <complexity>
+
+int32_t encoder_write(void *enc, int32_t *nchannels,int32_t *samplerate,
+                      int32_t *blocksize, char *buf, int32_t size){
+    if (size >= AOO_OPUS_CUSTOM_SETTINGSIZE){
+        auto c = static_cast<encoder *>(enc);
+        *nchannels = c->format.header.nchannels;
+        *samplerate = c->format.header.samplerate;
+        *blocksize = c->format.header.blocksize;
+        aoo::to_bytes<int32_t>(c->format.bitrate, buf);
+        aoo::to_bytes<int32_t>(c->format.complexity, buf + 4);
+
+        return AOO_OPUS_CUSTOM_SETTINGSIZE;
+    } else {
+        LOG_WARNING("Opus Custom: couldn't write settings");
+        return -1;
+    }
+}
+
+void *decoder_new(){
+    return new decoder;
+}
+
+void decoder_free(void *dec){
+    delete (decoder *)dec;
+}
+
+// a NULL buffer means packet loss concealment
+int32_t decode_block(decoder& c, const char *buf, int32_t size,
+                     aoo_sample *s, int32_t n)
+{
+    if (c.streams.empty()){
+        return 0;
+    }
+    auto nchannels = c.format.header.nchannels;
+    auto framesize = n / nchannels;
+    if (framesize != c.format.header.blocksize){
+        LOG_ERROR("Opus Custom: wrong number of samples");
+        return 0;
+    }
+    if (c.streams.size() == 1){
+        auto result = opus_custom_decode_float(c.streams[0], (const unsigned char *)buf,
+                                               size, s, framesize);
+        if (result > 0){
+            return result;
+        } else {
+            LOG_VERBOSE("Opus Custom: opus_custom_decode_float() failed with error code " << result);
+            return 0;
+        }
+    }
+    // one mono stream per channel
+    int32_t offset = 0;
+    for (int i = 0; i < nchannels; ++i){
+        const unsigned char *data = nullptr;
+        int32_t len = 0;
+        if (buf){
+            if (offset + 2 > size){
+                LOG_VERBOSE("Opus Custom: corrupt data");
+                return 0;
+            }
+            len = aoo::from_bytes<int16_t>(buf + offset);
+            if (len <= 0 || (offset + 2 + len) > size){
+                LOG_VERBOSE("Opus Custom: corrupt data");
+                return 0;
+            }
+            data = (const unsigned char *)buf + offset + 2;
+            offset += len + 2;
+        }
+        auto buffer = c.buffer.data();
+        auto result = opus_custom_decode_float(c.streams[i], data, len, buffer, framesize);
+        if (result > 0){
+            for (int j = 0; j < framesize; ++j){
+                s[j * nchannels + i] = buffer[j];
+            }
+        } else {
+            LOG_VERBOSE("Opus Custom: opus_custom_decode_float() failed with error code " << result);
+            return 0;
+        }
+    }
+    return framesize;
+}
+
+int32_t decoder_decode(void *dec,
+                       const char *buf, int32_t size,
+                       aoo_sample *s, int32_t n)
+{
+    return decode_block(*static_cast<decoder *>(dec), buf, size, s, n);
+}
+
+int32_t decoder_recover(void *dec,
+                        const char *buf, int32_t size,
+                        aoo_sample *s, int32_t n)
+{
+    // Opus Custom has no in-band FEC, so we always do packet loss concealment.
+    return decode_block(*static_cast<decoder *>(dec), nullptr, 0, s, n);
+}
+
+int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
+                     int32_t blocksize, const char *buf, int32_t size){
+    if (size >= AOO_OPUS_CUSTOM_SETTINGSIZE){
+        auto c = static_cast<decoder *>(dec);
+        if (nchannels < 1 || nchannels > 255){
+            LOG_ERROR("Opus Custom: bad channel count " << nchannels);
+            return -1;
+        }
+        // only recreate the decoder if the samplerate, blocksize
+        // or channel count has changed.
+        if (!c->mode || samplerate != c->format.header.samplerate
+                || blocksize != c->format.header.blocksize
+                || nchannels != c->format.header.nchannels){
+            c->destroy();
+            int error = 0;
+            c->mode = opus_custom_mode_create(samplerate, blocksize, &error);
+            if (error == OPUS_OK){
+                auto nstreams = num_streams(nchannels);
+                for (int i = 0; i < nstreams; ++i){
+                    auto state = opus_custom_decoder_create(c->mode, stream_channels(nchannels), &error);
+                    if (error == OPUS_OK){
+                        c->streams.push_back(state);
+                    } else {
+                        LOG_ERROR("Opus Custom: opus_custom_decoder_create() failed with error code " << error);
+                        c->destroy();
+                        break;
+                    }
+                }
+                c->buffer.resize(blocksize);
+            } else {
+                LOG_ERROR("Opus Custom: opus_custom_mode_create() failed with error code " << error);
+                c->mode = nullptr;
+            }
+        } else {
+            // a new stream (or a pooled decoder): don't carry over the old state
+            for (auto& state : c->streams){
+                opus_custom_decoder_ctl(state, OPUS_RESET_STATE);
+            }
+        }
+        c->format.header.nchannels = nchannels;
+        c->format.header.samplerate = samplerate;
+        c->format.header.blocksize = blocksize;
+        c->format.bitrate = aoo::from_bytes<int32_t>(buf);
+        c->format.complexity = aoo::from_bytes<int32_t>(buf + 4);
+
+        print_settings(c->format);
+
+        return AOO_OPUS_CUSTOM_SETTINGSIZE;
+    } else {
+        LOG_ERROR("Opus Custom: couldn't read settings - too little data!");
+        return -1;
+    }
+}
+
+aoo_codec codec_class = {
+    AOO_CODEC_OPUS_CUSTOM,
+    AOO_CODEC_OPUS_CUSTOM_ID,
+    encoder_new,
+    encoder_free,
+    encoder_setup,
+    encoder_encode,
+    encoder_write,
+    decoder_new,
+    decoder_free,
+    decoder_decode,
+    decoder_read,
+    decoder_recover
+};
+
+} // namespace
+
+void aoo_codec_opus_custom_setup(aoo_codec_registerfn fn){
+    fn(AOO_CODEC_OPUS_CUSTOM, &codec_class);
+}
+
+#else
+
+void aoo_codec_opus_custom_setup(aoo_codec_registerfn fn){}
+
+#endif // AOO_OPUS_CUSTOM
@@ -3,6 +3,43 @@
 
 #include <cassert>
 #include <cstring>
+#include <type_traits>
+
+// vectorized sample conversion (x86 only)
+#ifndef AOO_PCM_SIMD
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define AOO_PCM_SIMD 1
+# else
+#  define AOO_PCM_SIMD 0
+# endif
+#endif
+
+#if AOO_PCM_SIMD
+# include <emmintrin.h> // SSE2
+# include <tmmintrin.h> // SSSE3
+# include <immintrin.h> // F16C
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define AOO_TARGET_SSSE3
+#  define AOO_TARGET_F16C
+# else
+#  define AOO_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define AOO_TARGET_F16C __attribute__((target("f16c")))
+# endif
+#endif
+
+// half precision conversion on ARM
+#ifndef AOO_PCM_NEON
+# if defined(__aarch64__) || defined(_M_ARM64)
+#  define AOO_PCM_NEON 1
+# else
+#  define AOO_PCM_NEON 0
+# endif
+#endif
+
+#if AOO_PCM_NEON
+# include <arm_neon.h>
+#endif
 
 namespace {
 
@@ -18,7 +55,11 @@ union convert {
 
 int32_t bytes_per_sample(aoo_pcm_bitdepth bd){
     switch (bd){
+    case AOO_PCM_ULAW:
+    case AOO_PCM_ALAW:
+        return 1;
     case AOO_PCM_INT16:
+    case AOO_PCM_FLOAT16:
         return 2;
     case AOO_PCM_INT24:
         return 3;
@@ -32,10 +73,38 @@ int32_t bytes_per_sample(aoo_pcm_bitdepth bd){
     }
 }
 
+#if LOGLEVEL >= 2
+// only used by LOG_VERBOSE
+const char *bitdepth_name(aoo_pcm_bitdepth bd){
+    switch (bd){
+    case AOO_PCM_INT16:
+        return "int16";
+    case AOO_PCM_INT24:
+        return "int24";
+    case AOO_PCM_FLOAT32:
+        return "float32";
+    case AOO_PCM_FLOAT64:
+        return "float64";
+    case AOO_PCM_ULAW:
+        return "mu-law";
+    case AOO_PCM_ALAW:
+        return "A-law";
+    case AOO_PCM_FLOAT16:
+        return "float16";
+    default:
+        return "?";
+    }
+}
+#endif
+
+int16_t sample_to_int16(aoo_sample in){
+    int32_t temp = in * 0x7fff + 0.5f;
+    return (temp > INT16_MAX) ? INT16_MAX : (temp < INT16_MIN) ? INT16_MIN : temp;
+}
+
 void sample_to_int16(aoo_sample in, char *out){
     convert c;
-    int32_t temp = in * 0x7fff + 0.5f;
-    c.i16 = (temp > INT16_MAX) ? INT16_MAX : (temp < INT16_MIN) ? INT16_MIN : temp;
+    c.i16 = sample_to_int16(in);
 #if BYTE_ORDER == BIG_ENDIAN
     memcpy(out, c.b, 2); // optimized away
 #else
@@ -104,6 +173,603 @@ aoo_sample float64_to_sample(const char *in){
     return aoo::from_bytes<double>(in);
 }
 
+/*//////////////////// half precision ////////////////////*/
+
+// IEEE 754 binary16 with round-to-nearest-even, based on the public domain
+// code by Fabian Giesen. produces the same results as the F16C/NEON
+// instructions, including NaN payloads.
+
+uint16_t float_to_half(float f){
+    const uint32_t infinity = 255 << 23;
+    const uint32_t halfmax = (127 + 16) << 23; // 65536
+    const uint32_t denorm_magic = ((127 - 15) + (23 - 10) + 1) << 23;
+    convert c;
+    c.f = f;
+    uint32_t x = c.i32;
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+    uint16_t result;
+    if (x >= halfmax){
+        // Inf or NaN (keep the upper bits of the payload)
+        result = (x > infinity) ? (0x7e00 | ((x >> 13) & 0x3ff)) : 0x7c00;
+    } else if (x < (113u << 23)){
+        // subnormal or zero: let the FPU do the rounding
+        convert m;
+        m.i32 = denorm_magic;
+        c.i32 = x;
+        c.f += m.f;
+        result = (uint32_t)c.i32 - denorm_magic;
+    } else {
+        uint32_t odd = (x >> 13) & 1;
+        // rebias the exponent and round
+        x += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        result = x >> 13;
+    }
+    return result | (sign >> 16);
+}
+
+float half_to_float(uint16_t h){
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    convert c;
+    if (exponent == 0){
+        // zero or subnormal (exact)
+        c.f = (float)mantissa * (1.f / 16777216.f);
+        c.i32 |= sign;
+    } else if (exponent == 31){
+        // Inf or NaN (quiet)
+        c.i32 = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+    } else {
+        c.i32 = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    return c.f;
+}
+
+void sample_to_float16(aoo_sample in, char *out){
+    aoo::to_bytes<uint16_t>(float_to_half(in), out);
+}
+
+aoo_sample float16_to_sample(const char *in){
+    return half_to_float(aoo::from_bytes<uint16_t>(in));
+}
+
+/*//////////////////// G.711 ////////////////////*/
+
+// mu-law and A-law conversion, see the reference implementation by Sun
+// Microsystems (g711.c). we use the 14 resp. 13 most significant bits of
+// the int16 conversion above, so we can encode with a single table lookup.
+
+const int16_t ulaw_seg_end[8] = {
+    0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF
+};
+
+const int16_t alaw_seg_end[8] = {
+    0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF
+};
+
+int segment(int32_t value, const int16_t *table){
+    for (int i = 0; i < 8; ++i){
+        if (value <= table[i]){
+            return i;
+        }
+    }
+    return 8;
+}
+
+// 14 bit linear to mu-law
+uint8_t linear_to_ulaw(int32_t value){
+    const int32_t bias = 0x84 >> 2;
+    const int32_t clip = 8159;
+    int32_t mask;
+    if (value < 0){
+        value = -value;
+        mask = 0x7F;
+    } else {
+        mask = 0xFF;
+    }
+    if (value > clip){
+        value = clip;
+    }
+    value += bias;
+    auto seg = segment(value, ulaw_seg_end);
+    if (seg >= 8){
+        return 0x7F ^ mask;
+    } else {
+        return ((seg << 4) | ((value >> (seg + 1)) & 0xF)) ^ mask;
+    }
+}
+
+// 13 bit linear to A-law
+uint8_t linear_to_alaw(int32_t value){
+    int32_t mask;
+    if (value >= 0){
+        mask = 0xD5;
+    } else {
+        mask = 0x55;
+        value = -value - 1;
+    }
+    auto seg = segment(value, alaw_seg_end);
+    if (seg >= 8){
+        return 0x7F ^ mask;
+    } else {
+        int32_t aval = seg << 4;
+        if (seg < 2){
+            aval |= (value >> 1) & 0xF;
+        } else {
+            aval |= (value >> seg) & 0xF;
+        }
+        return aval ^ mask;
+    }
+}
+
+// mu-law to 16 bit linear
+int32_t ulaw_to_linear(uint8_t value){
+    const int32_t bias = 0x84;
+    value = ~value;
+    int32_t t = ((value & 0xF) << 3) + bias;
+    t <<= (value & 0x70) >> 4;
+    return (value & 0x80) ? (bias - t) : (t - bias);
+}
+
+// A-law to 16 bit linear
+int32_t alaw_to_linear(uint8_t value){
+    value ^= 0x55;
+    int32_t t = (value & 0xF) << 4;
+    int32_t seg = (value & 0x70) >> 4;
+    switch (seg){
+    case 0:
+        t += 8;
+        break;
+    case 1:
+        t += 0x108;
+        break;
+    default:
+        t += 0x108;
+        t <<= seg - 1;
+        break;
+    }
+    return (value & 0x80) ? t : -t;
+}
+
+struct g711_tables {
+    g711_tables(){
+        // sign extend the table index
+        for (int i = 0; i < (1 << 14); ++i){
+            ulaw_encode[i] = linear_to_ulaw(i < (1 << 13) ? i : i - (1 << 14));
+        }
+        for (int i = 0; i < (1 << 13); ++i){
+            alaw_encode[i] = linear_to_alaw(i < (1 << 12) ? i : i - (1 << 13));
+        }
+        for (int i = 0; i < 256; ++i){
+            ulaw_decode[i] = (aoo_sample)ulaw_to_linear(i) / 32768.f;
+            alaw_decode[i] = (aoo_sample)alaw_to_linear(i) / 32768.f;
+        }
+    }
+    uint8_t ulaw_encode[1 << 14]; // indexed by 14 bit linear
+    uint8_t alaw_encode[1 << 13]; // indexed by 13 bit linear
+    aoo_sample ulaw_decode[256];
+    aoo_sample alaw_decode[256];
+};
+
+const g711_tables& get_g711_tables(){
+    static const g711_tables tables;
+    return tables;
+}
+
+inline uint8_t int16_to_ulaw(int16_t in, const g711_tables& t){
+    return t.ulaw_encode[(uint16_t)in >> 2];
+}
+
+inline uint8_t int16_to_alaw(int16_t in, const g711_tables& t){
+    return t.alaw_encode[(uint16_t)in >> 3];
+}
+
+void ulaw_encode(const aoo_sample *in, char *out, int32_t n){
+    auto& t = get_g711_tables();
+    for (int i = 0; i < n; ++i){
+        out[i] = int16_to_ulaw(sample_to_int16(in[i]), t);
+    }
+}
+
+void alaw_encode(const aoo_sample *in, char *out, int32_t n){
+    auto& t = get_g711_tables();
+    for (int i = 0; i < n; ++i){
+        out[i] = int16_to_alaw(sample_to_int16(in[i]), t);
+    }
+}
+
+void ulaw_decode(const char *in, aoo_sample *out, int32_t n){
+    auto table = get_g711_tables().ulaw_decode;
+    for (int i = 0; i < n; ++i){
+        out[i] = table[(uint8_t)in[i]];
+    }
+}
+
+void alaw_decode(const char *in, aoo_sample *out, int32_t n){
+    auto table = get_g711_tables().alaw_decode;
+    for (int i = 0; i < n; ++i){
+        out[i] = table[(uint8_t)in[i]];
+    }
+}
+
+/*//////////////////// block conversion ////////////////////*/
+
+typedef void (*encode_fn)(const aoo_sample *in, char *out, int32_t n);
+typedef void (*decode_fn)(const char *in, aoo_sample *out, int32_t n);
+
+template<void (*fn)(aoo_sample, char *), int32_t size>
+void encode_block(const aoo_sample *in, char *out, int32_t n){
+    for (int i = 0; i < n; ++i, out += size){
+        fn(in[i], out);
+    }
+}
+
+template<aoo_sample (*fn)(const char *), int32_t size>
+void decode_block(const char *in, aoo_sample *out, int32_t n){
+    for (int i = 0; i < n; ++i, in += size){
+        out[i] = fn(in);
+    }
+}
+
+struct kernel_table {
+    encode_fn encode[AOO_PCM_BITDEPTH_SIZE];
+    decode_fn decode[AOO_PCM_BITDEPTH_SIZE];
+};
+
+// NOTE: the SIMD kernels must produce exactly the same output as the
+// scalar conversion routines above, including rounding and clipping!
+// the remaining samples of each block are handled by the scalar routines.
+
+template<typename T>
+void simd_setup(void (**enc)(const T *, char *, int32_t),
+                void (**dec)(const char *, T *, int32_t)){
+    // no SIMD kernels for this sample type
+}
+
+#if AOO_PCM_SIMD
+
+inline __m128i bswap16_sse2(__m128i x){
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+inline __m128i bswap32_sse2(__m128i x){
+    // first swap the 16 bit halves
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return bswap16_sse2(x);
+}
+
+inline __m128i bswap64_sse2(__m128i x){
+    // first swap the 32 bit halves
+    return bswap32_sse2(_mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+void int16_encode_sse2(const float *in, char *out, int32_t n){
+    const __m128 scale = _mm_set1_ps(0x7fff);
+    const __m128 half = _mm_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half);
+        auto b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), half);
+        // truncate and clip
+        auto x = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + i * 2), bswap16_sse2(x));
+    }
+    for (; i < n; ++i){
+        sample_to_int16(in[i], out + i * 2);
+    }
+}
+
+void int16_decode_sse2(const char *in, float *out, int32_t n){
+    const __m128 scale = _mm_set1_ps(1.f / 32768.f); // exact
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto x = bswap16_sse2(_mm_loadu_si128((const __m128i *)(in + i * 2)));
+        // sign extend to 32 bit
+        auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    for (; i < n; ++i){
+        out[i] = int16_to_sample(in + i * 2);
+    }
+}
+
+AOO_TARGET_SSSE3
+void int24_encode_ssse3(const float *in, char *out, int32_t n){
+    const __m128 scale = _mm_set1_ps(0x7fffffff);
+    const __m128 half = _mm_set1_ps(0.5f);
+    // the highest 3 bytes of each sample in big endian order
+    const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13,
+                                          -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half);
+        auto x = _mm_shuffle_epi8(_mm_cvttps_epi32(a), shuffle);
+        // store 12 bytes
+        auto b = out + i * 3;
+        _mm_storel_epi64((__m128i *)b, x);
+        int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+        memcpy(b + 8, &tail, 4);
+    }
+    for (; i < n; ++i){
+        sample_to_int24(in[i], out + i * 3);
+    }
+}
+
+AOO_TARGET_SSSE3
+void int24_decode_ssse3(const char *in, float *out, int32_t n){
+    const __m128 scale = _mm_set1_ps(1.f / 2147483648.f); // exact
+    // big endian 3 byte samples to the highest 3 bytes of 32 bit integers
+    const __m128i shuffle = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3,
+                                          -1, 8, 7, 6, -1, 11, 10, 9);
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        // load 12 bytes
+        auto b = in + i * 3;
+        int32_t tail;
+        memcpy(&tail, b + 8, 4);
+        auto x = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)b),
+                                    _mm_cvtsi32_si128(tail));
+        x = _mm_shuffle_epi8(x, shuffle);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    for (; i < n; ++i){
+        out[i] = int24_to_sample(in + i * 3);
+    }
+}
+
+void float32_encode_sse2(const float *in, char *out, int32_t n){
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto x = _mm_castps_si128(_mm_loadu_ps(in + i));
+        _mm_storeu_si128((__m128i *)(out + i * 4), bswap32_sse2(x));
+    }
+    for (; i < n; ++i){
+        sample_to_float32(in[i], out + i * 4);
+    }
+}
+
+void float32_decode_sse2(const char *in, float *out, int32_t n){
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto x = bswap32_sse2(_mm_loadu_si128((const __m128i *)(in + i * 4)));
+        _mm_storeu_ps(out + i, _mm_castsi128_ps(x));
+    }
+    for (; i < n; ++i){
+        out[i] = float32_to_sample(in + i * 4);
+    }
+}
+
+void float64_encode_sse2(const float *in, char *out, int32_t n){
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto x = _mm_loadu_ps(in + i);
+        auto lo = _mm_castpd_si128(_mm_cvtps_pd(x));
+        auto hi = _mm_castpd_si128(_mm_cvtps_pd(_mm_movehl_ps(x, x)));
+        _mm_storeu_si128((__m128i *)(out + i * 8), bswap64_sse2(lo));
+        _mm_storeu_si128((__m128i *)(out + i * 8 + 16), bswap64_sse2(hi));
+    }
+    for (; i < n; ++i){
+        sample_to_float64(in[i], out + i * 8);
+    }
+}
+
+void float64_decode_sse2(const char *in, float *out, int32_t n){
+    int i = 0;
+    for (; i + 4 <= n; i += 4){
+        auto lo = bswap64_sse2(_mm_loadu_si128((const __m128i *)(in + i * 8)));
+        auto hi = bswap64_sse2(_mm_loadu_si128((const __m128i *)(in + i * 8 + 16)));
+        auto x = _mm_movelh_ps(_mm_cvtpd_ps(_mm_castsi128_pd(lo)),
+                               _mm_cvtpd_ps(_mm_castsi128_pd(hi)));
+        _mm_storeu_ps(out + i, x);
+    }
+    for (; i < n; ++i){
+        out[i] = float64_to_sample(in + i * 8);
+    }
+}
+
+// vectorized int16 conversion + table lookup
+template<uint8_t (*fn)(int16_t, const g711_tables&)>
+void g711_encode_sse2(const float *in, char *out, int32_t n){
+    auto& t = get_g711_tables();
+    const __m128 scale = _mm_set1_ps(0x7fff);
+    const __m128 half = _mm_set1_ps(0.5f);
+    alignas(16) int16_t temp[8];
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto a = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), half);
+        auto b = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), half);
+        // truncate and clip
+        _mm_store_si128((__m128i *)temp,
+                        _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+        for (int j = 0; j < 8; ++j){
+            out[i + j] = fn(temp[j], t);
+        }
+    }
+    for (; i < n; ++i){
+        out[i] = fn(sample_to_int16(in[i]), t);
+    }
+}
+
+AOO_TARGET_F16C
+void float16_encode_f16c(const float *in, char *out, int32_t n){
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto a = _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        auto b = _mm_cvtps_ph(_mm_loadu_ps(in + i + 4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(out + i * 2), bswap16_sse2(_mm_unpacklo_epi64(a, b)));
+    }
+    for (; i < n; ++i){
+        sample_to_float16(in[i], out + i * 2);
+    }
+}
+
+AOO_TARGET_F16C
+void float16_decode_f16c(const char *in, float *out, int32_t n){
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto x = bswap16_sse2(_mm_loadu_si128((const __m128i *)(in + i * 2)));
+        _mm_storeu_ps(out + i, _mm_cvtph_ps(x));
+        _mm_storeu_ps(out + i + 4, _mm_cvtph_ps(_mm_srli_si128(x, 8)));
+    }
+    for (; i < n; ++i){
+        out[i] = float16_to_sample(in + i * 2);
+    }
+}
+
+bool cpu_has_f16c(){
+#if defined(__F16C__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // F16C, AVX and OSXSAVE + the OS must save the YMM registers
+    const int mask = (1 << 29) | (1 << 28) | (1 << 27);
+    return ((info[2] & mask) == mask) && ((_xgetbv(0) & 6) == 6);
+#else
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+
+bool cpu_has_ssse3(){
+#if defined(__SSSE3__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+void simd_setup(void (**enc)(const float *, char *, int32_t),
+                void (**dec)(const char *, float *, int32_t)){
+    // SSE2 is always available
+    enc[AOO_PCM_INT16] = int16_encode_sse2;
+    dec[AOO_PCM_INT16] = int16_decode_sse2;
+    enc[AOO_PCM_FLOAT32] = float32_encode_sse2;
+    dec[AOO_PCM_FLOAT32] = float32_decode_sse2;
+    enc[AOO_PCM_FLOAT64] = float64_encode_sse2;
+    dec[AOO_PCM_FLOAT64] = float64_decode_sse2;
+    enc[AOO_PCM_ULAW] = g711_encode_sse2<int16_to_ulaw>;
+    enc[AOO_PCM_ALAW] = g711_encode_sse2<int16_to_alaw>;
+    if (cpu_has_ssse3()){
+        enc[AOO_PCM_INT24] = int24_encode_ssse3;
+        dec[AOO_PCM_INT24] = int24_decode_ssse3;
+        LOG_VERBOSE("PCM: using SSSE3 kernels");
+    } else {
+        LOG_VERBOSE("PCM: using SSE2 kernels");
+    }
+    if (cpu_has_f16c()){
+        enc[AOO_PCM_FLOAT16] = float16_encode_f16c;
+        dec[AOO_PCM_FLOAT16] = float16_decode_f16c;
+        LOG_VERBOSE("PCM: using F16C kernels");
+    }
+}
+
+#endif // AOO_PCM_SIMD
+
+#if AOO_PCM_NEON
+
+void float16_encode_neon(const float *in, char *out, int32_t n){
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto a = vcvt_f16_f32(vld1q_f32(in + i));
+        auto b = vcvt_f16_f32(vld1q_f32(in + i + 4));
+        auto x = vreinterpretq_u8_f16(vcombine_f16(a, b));
+        vst1q_u8((uint8_t *)(out + i * 2), vrev16q_u8(x)); // big endian
+    }
+    for (; i < n; ++i){
+        sample_to_float16(in[i], out + i * 2);
+    }
+}
+
+void float16_decode_neon(const char *in, float *out, int32_t n){
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        auto x = vrev16q_u8(vld1q_u8((const uint8_t *)(in + i * 2)));
+        auto h = vreinterpretq_f16_u8(x);
+        vst1q_f32(out + i, vcvt_f32_f16(vget_low_f16(h)));
+        vst1q_f32(out + i + 4, vcvt_f32_f16(vget_high_f16(h)));
+    }
+    for (; i < n; ++i){
+        out[i] = float16_to_sample(in + i * 2);
+    }
+}
+
+void simd_setup(void (**enc)(const float *, char *, int32_t),
+                void (**dec)(const char *, float *, int32_t)){
+    // half precision conversion is always available on AArch64
+    enc[AOO_PCM_FLOAT16] = float16_encode_neon;
+    dec[AOO_PCM_FLOAT16] = float16_decode_neon;
+    LOG_VERBOSE("PCM: using NEON kernels");
+}
+
+#endif // AOO_PCM_NEON
+
+// bulk conversion if the sample type matches the wire format
+
+void float32_encode(const aoo_sample *in, char *out, int32_t n){
+    if (std::is_same<aoo_sample, float>::value){
+        aoo::to_bytes<float>((const float *)in, out, n);
+    } else {
+        encode_block<sample_to_float32, 4>(in, out, n);
+    }
+}
+
+void float32_decode(const char *in, aoo_sample *out, int32_t n){
+    if (std::is_same<aoo_sample, float>::value){
+        aoo::from_bytes<float>(in, (float *)out, n);
+    } else {
+        decode_block<float32_to_sample, 4>(in, out, n);
+    }
+}
+
+void float64_encode(const aoo_sample *in, char *out, int32_t n){
+    if (std::is_same<aoo_sample, double>::value){
+        aoo::to_bytes<double>((const double *)in, out, n);
+    } else {
+        encode_block<sample_to_float64, 8>(in, out, n);
+    }
+}
+
+void float64_decode(const char *in, aoo_sample *out, int32_t n){
+    if (std::is_same<aoo_sample, double>::value){
+        aoo::from_bytes<double>(in, (double *)out, n);
+    } else {
+        decode_block<float64_to_sample, 8>(in, out, n);
+    }
+}
+
+const kernel_table& get_kernels(){
+    static const kernel_table table = [](){
+        kernel_table t;
+        t.encode[AOO_PCM_INT16] = encode_block<sample_to_int16, 2>;
+        t.encode[AOO_PCM_INT24] = encode_block<sample_to_int24, 3>;
+        t.encode[AOO_PCM_FLOAT32] = float32_encode;
+        t.encode[AOO_PCM_FLOAT64] = float64_encode;
+        t.decode[AOO_PCM_INT16] = decode_block<int16_to_sample, 2>;
+        t.decode[AOO_PCM_INT24] = decode_block<int24_to_sample, 3>;
+        t.decode[AOO_PCM_FLOAT32] = float32_decode;
+        t.decode[AOO_PCM_FLOAT64] = float64_decode;
+        t.encode[AOO_PCM_FLOAT16] = encode_block<sample_to_float16, 2>;
+        t.decode[AOO_PCM_FLOAT16] = decode_block<float16_to_sample, 2>;
+        // G.711 is table driven
+        t.encode[AOO_PCM_ULAW] = ulaw_encode;
+        t.encode[AOO_PCM_ALAW] = alaw_encode;
+        t.decode[AOO_PCM_ULAW] = ulaw_decode;
+        t.decode[AOO_PCM_ALAW] = alaw_decode;
+        // only for float samples (overload resolution)
+        simd_setup(t.encode, t.decode);
+        return t;
+    }();
+    return table;
+}
+
 struct codec {
     aoo_format_pcm format;
 };
@@ -113,7 +779,7 @@ void print_settings(const aoo_format_pcm& f){
                 << "nchannels = " << f.header.nchannels
                 << ", blocksize = " << f.header.blocksize
                 << ", samplerate = " << f.header.samplerate
-                << ", bitdepth = " << bytes_per_sample(f.bitdepth));
+                << ", bitdepth = " << bitdepth_name(f.bitdepth));
 }
 
 void *encoder_new(){
@@ -148,7 +814,7 @@ void encoder_setup(void *enc, aoo_format *f){
         fmt->header.nchannels = 1;
     }
     // validate bitdepth
-    if (fmt->bitdepth < 0 || fmt->bitdepth > AOO_PCM_BITDEPTH_SIZE){
+    if (fmt->bitdepth < 0 || fmt->bitdepth >= AOO_PCM_BITDEPTH_SIZE){
         LOG_WARNING("PCM: bad bitdepth, using 32bit float");
         fmt->bitdepth = AOO_PCM_FLOAT32;
     }
@@ -167,30 +833,10 @@ int32_t encoder_encode(void *enc,
 
     assert(size >= n * samplesize);
 
-    auto samples_to_blob = [&](auto fn){
-        auto b = buf;
-        for (int i = 0; i < n; ++i){
-            fn(s[i], b);
-            b += samplesize;
-        }
-    };
-
-    switch (bitdepth){
-    case AOO_PCM_INT16:
-        samples_to_blob(sample_to_int16);
-        break;
-    case AOO_PCM_INT24:
-        samples_to_blob(sample_to_int24);
-        break;
-    case AOO_PCM_FLOAT32:
-        samples_to_blob(sample_to_float32);
-        break;
-    case AOO_PCM_FLOAT64:
-        samples_to_blob(sample_to_float64);
-        break;
-    default:
+    if (bitdepth >= 0 && bitdepth < AOO_PCM_BITDEPTH_SIZE){
+        get_kernels().encode[bitdepth](s, buf, n);
+    } else {
         // unknown bitdepth
-        break;
     }
 
     return n * samplesize;
@@ -231,27 +877,10 @@ int32_t decoder_decode(void *dec,
 
     assert(n >= (size / samplesize));
 
-    auto blob_to_samples = [&](auto convfn){
-        auto b = buf;
-        for (int i = 0; i < n; ++i, b += samplesize){
-            s[i] = convfn(b);
-        }
-    };
-
-    switch (c->format.bitdepth){
-    case AOO_PCM_INT16:
-        blob_to_samples(int16_to_sample);
-        break;
-    case AOO_PCM_INT24:
-        blob_to_samples(int24_to_sample);
-        break;
-    case AOO_PCM_FLOAT32:
-        blob_to_samples(float32_to_sample);
-        break;
-    case AOO_PCM_FLOAT64:
-        blob_to_samples(float64_to_sample);
-        break;
-    default:
+    auto bitdepth = c->format.bitdepth;
+    if (bitdepth >= 0 && bitdepth < AOO_PCM_BITDEPTH_SIZE){
+        get_kernels().decode[bitdepth](buf, s, n);
+    } else {
         // unknown bitdepth
         return 0;
     }
@@ -266,8 +895,12 @@ int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
         c->format.header.nchannels = nchannels;
         c->format.header.samplerate = samplerate;
         c->format.header.blocksize = blocksize;
-        c->format.bitdepth = (aoo_pcm_bitdepth)aoo::from_bytes<int32_t>(buf);
-        // TODO validate
+        auto bitdepth = aoo::from_bytes<int32_t>(buf);
+        if (bitdepth < 0 || bitdepth >= AOO_PCM_BITDEPTH_SIZE){
+            LOG_ERROR("PCM: bad bitdepth " << bitdepth);
+            return -1;
+        }
+        c->format.bitdepth = (aoo_pcm_bitdepth)bitdepth;
         print_settings(c->format);
         return 4;
     } else {
@@ -278,6 +911,7 @@ int32_t decoder_read(void *dec, int32_t nchannels, int32_t samplerate,
 
 aoo_codec codec_class = {
     AOO_CODEC_PCM,
+    AOO_CODEC_PCM_ID,
     encoder_new,
     encoder_free,
     encoder_setup,
@@ -286,7 +920,8 @@ aoo_codec codec_class = {
     decoder_new,
     decoder_free,
     decoder_decode,
-    decoder_read
+    decoder_read,
+    nullptr // no recovery
 };
 
 } // namespace
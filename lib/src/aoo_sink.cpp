@@ -3,6 +3,7 @@
 #include "aoo/aoo_osc.hpp"
 
 #include <algorithm>
+#include <cmath>
 
 namespace aoo {
 
@@ -56,6 +57,9 @@ void aoo_sink::setup(aoo_sink_settings& settings){
     resend_interval_ = std::max<int32_t>(0, settings.resend_interval);
     resend_maxnumframes_ = std::max<int32_t>(1, settings.resend_maxnumframes);
     resend_packetsize_ = std::max<int32_t>(64, std::min<int32_t>(AOO_MAXPACKETSIZE, settings.resend_packetsize));
+    playout_delay_ = std::max<int32_t>(0, settings.playout_delay);
+    ping_interval_ = std::max<int32_t>(0, settings.ping_interval);
+    reliable_ = settings.reliable != 0;
     bandwidth_ = std::max<double>(0, std::min<double>(1, settings.time_filter_bandwidth));
     starttime_ = 0; // will update time DLL
     elapsedtime_.reset();
@@ -65,37 +69,84 @@ void aoo_sink::setup(aoo_sink_settings& settings){
         // don't need to lock
         update_source(src);
     }
+    // pre-build decoders, so that new sources and format changes
+    // don't have to allocate. the pool is used by handle_format_message().
+    std::unique_lock<std::mutex> lock(mutex_);
+    decoder_pool_.fill(-1, [](const aoo::codec& c){
+        return c.create_decoder();
+    });
 }
 
 int32_t aoo_sink_handlemessage(aoo_sink *sink, const char *data, int32_t n,
                             void *src, aoo_replyfn fn) {
-    return sink->handle_message(data, n, src, fn);
+    return sink->handle_message(data, n, src, fn, 0);
 }
 
-// /AoO/<sink>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <settings...>
-// /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+int32_t aoo_sink_handlemessage_timed(aoo_sink *sink, const char *data, int32_t n,
+                                  void *src, aoo_replyfn fn, uint64_t t) {
+    return sink->handle_message(data, n, src, fn, t);
+}
+
+// /AoO/<sink>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <settings...> [<flags>]
+// /AoO/<sink>/data <src> <salt> <seq> <time> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+// (older sources omit <time>)
+// (or binary data message, see aoo_imp.hpp)
+// /AoO/<sink>/ping <src> <t1>
+// /AoO/<sink>/pong <src> <t1> <t2>
 
 int32_t aoo_sink::handle_message(const char *data, int32_t n, void *endpoint, aoo_replyfn fn){
-    aoo::osc::received_packet packet(data, n);
+    return handle_message(data, n, endpoint, fn, 0);
+}
 
-    if (packet.is_bundle()){
-        LOG_WARNING("OSC bundles are not supported (yet)");
-        return 0; // ?
+int32_t aoo_sink::handle_message(const char *data, int32_t n, void *endpoint,
+                                 aoo_replyfn fn, uint64_t t){
+    // arrival time
+    if (!t){
+        t = aoo_osctime_get();
     }
 
-    aoo::osc::received_message msg(packet);
-    if (!msg.check()){
-        LOG_ERROR("received malformed OSC message!");
-        return 0; // ?
+    if (aoo::is_binary_data(data, n)){
+        if (samplerate_ == 0){
+            return 1; // not setup yet
+        }
+        int32_t sink, id, salt;
+        aoo::data_packet d;
+        if (!aoo::read_binary_data(data, n, sink, id, salt, d)){
+            LOG_ERROR("received malformed binary /data message!");
+            return 1;
+        }
+        if (sink != id_ && sink != AOO_ID_WILDCARD){
+            LOG_WARNING("wrong sink ID!");
+            return 1; // ?
+        }
+        handle_data_message(endpoint, fn, id, salt, d, aoo::time_tag(t).to_double(),
+                            AOO_FLAG_BINDATA);
+        return 1;
+    }
+
+    aoo::osc::received_packet packet(data, n);
+
+    if (packet.is_bundle()){
+        aoo::osc::received_bundle bundle(packet);
+        if (!bundle.check()){
+            LOG_ERROR("received malformed OSC bundle!");
+            return 0; // ?
+        }
+        // the elements are handled immediately (time tag is ignored)
+        for (auto elem : bundle){
+            handle_message(elem.data(), elem.size(), endpoint, fn, t);
+        }
+        return 1;
     }
 
     if (samplerate_ == 0){
         return 1; // not setup yet
     }
 
+    // check the address pattern before parsing the arguments
     int32_t sink = 0;
-    auto onset = aoo_parsepattern(data, n, &sink);
-    if (!onset){
+    auto type = aoo_parsemessage(data, n, &sink);
+    if (type == AOO_MSG_NONE){
         LOG_WARNING("not an AoO message!");
         return 1; // ?
     }
@@ -104,8 +155,43 @@ int32_t aoo_sink::handle_message(const char *data, int32_t n, void *endpoint, ao
         return 1; // ?
     }
 
-    if (!strcmp(msg.address_pattern() + onset, AOO_FORMAT)){
-        if (msg.count() == AOO_FORMAT_NARGS){
+    if (type == AOO_MSG_DATA){
+        // fast path: check the type tags once and read the arguments at fixed offsets
+        int32_t id, salt;
+        aoo::data_packet d;
+        aoo::osc::timetag time;
+        aoo::osc::blob b;
+        bool ok = false;
+        if (aoo::data_message::read(data, n, id, salt, d.sequence, time, d.samplerate,
+                                    d.channel, d.totalsize, d.nframes, d.framenum, b)){
+            d.time = aoo::time_tag(time).to_double();
+            ok = true;
+        } else if (aoo::data_message_notime::read(data, n, id, salt, d.sequence, d.samplerate,
+                                                  d.channel, d.totalsize, d.nframes, d.framenum, b)){
+            d.time = 0; // unknown
+            ok = true;
+        }
+        if (ok){
+            d.data = b.data;
+            d.size = b.size;
+            ok = aoo::check_data_packet(d);
+        }
+        if (ok){
+            handle_data_message(endpoint, fn, id, salt, d, aoo::time_tag(t).to_double(), 0);
+        } else {
+            LOG_ERROR("received malformed /data message!");
+        }
+        return 1;
+    }
+
+    aoo::osc::received_message msg(packet);
+    if (!msg.check()){
+        LOG_ERROR("received malformed OSC message!");
+        return 0; // ?
+    }
+
+    if (type == AOO_MSG_FORMAT){
+        if (msg.count() == AOO_FORMAT_NARGS || msg.count() == AOO_FORMAT_NARGS + 1){
         #if 0
             std::cerr << "received format message:\n";
             for (int i = 0; i < msg.size(); ++i){
@@ -121,74 +207,96 @@ int32_t aoo_sink::handle_message(const char *data, int32_t n, void *endpoint, ao
             f.nchannels = (it++)->as_int32();
             f.samplerate = (it++)->as_int32();
             f.blocksize = (it++)->as_int32();
-            f.codec = (it++)->as_string();
+            // codec ID (older sources send the codec name)
+            const aoo::codec *c = nullptr;
+            if (it->type() == 'i'){
+                auto codec = (it++)->as_int32();
+                c = aoo::find_codec(codec);
+                if (!c){
+                    LOG_ERROR("codec ID " << codec << " not supported!");
+                    return 1;
+                }
+            } else {
+                auto codec = (it++)->as_string();
+                if (!codec){
+                    LOG_ERROR("missing codec argument in /format message!");
+                    return 1;
+                }
+                c = aoo::find_codec(codec);
+                if (!c){
+                    LOG_ERROR("codec '" << codec << "' not supported!");
+                    return 1;
+                }
+            }
+            f.codec = c->name();
             auto b = (it++)->as_blob();
+            // optional flags
+            auto flags = (msg.count() > AOO_FORMAT_NARGS) ? (it++)->as_int32() : 0;
 
             std::cerr << id << " " << salt << " " << f.nchannels << " "
                       << f.samplerate << " " << f.blocksize << " " << f.codec;
 
-            if (!f.codec){
-                LOG_ERROR("missing codec argument in /format message!");
-                std::terminate();
-                return 1; // ?
-            }
-
-            handle_format_message(endpoint, fn, id, salt, f, b.data, b.size);
+            handle_format_message(endpoint, fn, id, salt, *c, f, b.data, b.size, flags);
         } else {
             LOG_ERROR("wrong number of arguments for /format message");
         }
-    } else if (!strcmp(msg.address_pattern() + onset, AOO_DATA)){
-        if (msg.count() == AOO_DATA_NARGS){
-        #if 0
-            std::cerr << "received data message:\n";
-            for (int i = 0; i < msg.size(); ++i){
-                std::cerr << (int)(uint8_t)msg.data()[i] << " ";
-            }
-            std::cerr << std::endl;
-        #endif
+    } else if (type == AOO_MSG_PING){
+        if (msg.count() == 2){
             auto it = msg.begin();
-            // get header from arguments
             auto id = (it++)->as_int32();
-            auto salt = (it++)->as_int32();
-            aoo::data_packet d;
-            d.sequence = (it++)->as_int32();
-            d.samplerate = (it++)->as_double();
-            d.channel = (it++)->as_int32();
-            d.totalsize = (it++)->as_int32();
-            d.nframes = (it++)->as_int32();
-            d.framenum = (it++)->as_int32();
-            auto b = (it++)->as_blob();
-            d.data = b.data;
-            d.size = b.size;
-
-            handle_data_message(endpoint, fn, id, salt, d);
+            auto t1 = (it++)->as_timetag();
+            // reply immediately
+            send_pong(endpoint, fn, id, t1, t);
+        } else {
+            LOG_ERROR("wrong number of arguments for /ping message");
+        }
+    } else if (type == AOO_MSG_PONG){
+        if (msg.count() == 3){
+            auto t4 = aoo::time_tag(t).to_double();
+            auto it = msg.begin();
+            auto id = (it++)->as_int32();
+            auto t1 = aoo::time_tag((it++)->as_timetag()).to_double();
+            auto t2 = aoo::time_tag((it++)->as_timetag()).to_double();
+            auto src = std::find_if(sources_.begin(), sources_.end(), [&](auto& s){
+                return (s.endpoint == endpoint) && (s.id == id);
+            });
+            if (src != sources_.end()){
+                src->rtt.update(t4 - t1);
+                src->offset.update(t1, t2, t4);
+                LOG_DEBUG("aoo_sink: source " << id << " rtt = " << src->rtt.rtt()
+                          << ", jitter = " << src->rtt.jitter());
+            } else {
+                LOG_VERBOSE("ignoring '/pong' message: source not found");
+            }
         } else {
-            LOG_ERROR("wrong number of arguments for /data message");
+            LOG_ERROR("wrong number of arguments for /pong message");
         }
     } else {
-        LOG_WARNING("unknown message '" << (msg.address_pattern() + onset) << "'");
+        LOG_WARNING("unknown message '" << msg.address_pattern() << "'");
     }
     return 1; // ?
 }
 
 void aoo_sink::handle_format_message(void *endpoint, aoo_replyfn fn,
-                                     int32_t id, int32_t salt, const aoo_format& f,
-                                     const char *settings, int32_t size){
+                                     int32_t id, int32_t salt, const aoo::codec& codec,
+                                     const aoo_format& f, const char *settings, int32_t size,
+                                     int32_t flags){
     LOG_DEBUG("handle format message");
 
     auto update_format = [&](aoo::source_desc& src){
-        if (!src.decoder || strcmp(src.decoder->name(), f.codec)){
-            auto c = aoo::find_codec(f.codec);
-            if (c){
-                src.decoder = c->create_decoder();
-            } else {
-                LOG_ERROR("codec '" << f.codec << "' not supported!");
-                return;
-            }
-            if (!src.decoder){
-                LOG_ERROR("couldn't create decoder!");
-                return;
+        // reuse the current decoder if possible; otherwise try
+        // the pool before creating a new instance.
+        if (!src.decoder || src.decoder->id() != codec.id()){
+            auto decoder = decoder_pool_.take(codec.id());
+            if (!decoder){
+                decoder = codec.create_decoder();
+                if (!decoder){
+                    LOG_ERROR("couldn't create decoder!");
+                    return;
+                }
             }
+            decoder_pool_.put(std::move(src.decoder));
+            src.decoder = std::move(decoder);
         }
         src.decoder->read(f.nchannels, f.samplerate, f.blocksize, settings, size);
 
@@ -209,21 +317,40 @@ void aoo_sink::handle_format_message(void *endpoint, aoo_replyfn fn,
         auto src = std::find_if(sources_.begin(), sources_.end(), [&](auto& s){
             return (s.endpoint == endpoint) && (s.id == id);
         });
-        std::unique_lock<std::mutex> lock(mutex_); // !
-        if (src == sources_.end()){
-            // not found - add new source
-            sources_.emplace_back(endpoint, fn, id, salt);
-            src = sources_.end() - 1;
-        } else {
-            src->salt = salt;
+        if (src != sources_.end() && src->salt == salt && src->decoder){
+            // the source has resent its current format,
+            // but it might offer binary data messages now.
+            if ((flags & AOO_FLAG_BINDATA) && !src->bindata){
+                src->bindata = true;
+                request_format(endpoint, fn, id, AOO_FLAG_BINDATA);
+            } else if (!(flags & AOO_FLAG_BINDATA)){
+                src->bindata = false;
+            }
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex_); // !
+            if (src == sources_.end()){
+                // not found - add new source
+                sources_.emplace_back(endpoint, fn, id, salt);
+                src = sources_.end() - 1;
+            } else {
+                src->salt = salt;
+            }
+            // update source
+            update_format(*src);
+        }
+        // accept binary data messages
+        src->bindata = (flags & AOO_FLAG_BINDATA) != 0;
+        if (src->bindata){
+            request_format(endpoint, fn, id, AOO_FLAG_BINDATA);
         }
-        // update source
-        update_format(*src);
     }
 }
 
 void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
-                                   int32_t salt, const aoo::data_packet& d){
+                                   int32_t salt, const aoo::data_packet& d, double arrival,
+                                   int32_t flags){
     // first try to find existing source
     auto result = std::find_if(sources_.begin(), sources_.end(), [&](auto& s){
         return (s.endpoint == endpoint) && (s.id == id);
@@ -242,7 +369,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
     #else
         assert(src.decoder != nullptr);
     #endif
-        LOG_DEBUG("got block: seq = " << d.sequence << ", sr = " << d.samplerate
+        LOG_DEBUG("got block: seq = " << d.sequence << ", time = " << d.time << ", sr = " << d.samplerate
                   << ", chn = " << d.channel << ", totalsize = " << d.totalsize
                   << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size);
 
@@ -257,7 +384,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
         }
 
         if (d.sequence < src.newest){
-            if (acklist.find(d.sequence)){
+            if (!reliable_ && acklist.find(d.sequence)){
                 LOG_DEBUG("resent block " << d.sequence);
             } else {
                 LOG_VERBOSE("block " << d.sequence << " out of order!");
@@ -285,6 +412,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                 // push nominal samplerate + default channel (0)
                 aoo::source_desc::info i;
                 i.sr = src.decoder->samplerate();
+                i.time = 0;
                 i.channel = 0;
                 i.state = AOO_SOURCE_STOP;
                 src.infoqueue.write(i);
@@ -308,6 +436,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                     // push nominal samplerate + default channel (0)
                     aoo::source_desc::info i;
                     i.sr = src.decoder->samplerate();
+                    i.time = 0;
                     i.channel = 0;
                     i.state = AOO_SOURCE_STOP;
                     src.infoqueue.write(i);
@@ -317,7 +446,10 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                 acklist.remove(queue.front().sequence);
             }
             // add new block
-            block = queue.insert(d.sequence, d.samplerate, d.channel, d.totalsize, d.nframes);
+            block = queue.insert(d.sequence, d.time, d.samplerate, d.channel, d.totalsize, d.nframes);
+        } else if (d.nframes != block->num_frames() || d.totalsize != block->size()){
+            LOG_ERROR("frame " << d.framenum << " doesn't match block " << d.sequence);
+            return;
         } else if (block->has_frame(d.framenum)){
             LOG_VERBOSE("frame " << d.framenum << " of block " << d.sequence << " already received!");
             return;
@@ -335,6 +467,15 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
 
         // update newest sequence number
         if (d.sequence > src.newest){
+            // interarrival jitter (RFC 3550). only consider the first
+            // frame of new blocks, resent blocks would distort the result.
+            if (d.time > 0){
+                auto transit = arrival - d.time;
+                if (src.transit != 0){
+                    src.jitter += (std::abs(transit - src.transit) - src.jitter) / 16.0;
+                }
+                src.transit = transit;
+            }
             src.newest = d.sequence;
         }
 
@@ -344,10 +485,31 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
             block = queue.begin();
             int32_t count = 0;
             int32_t next = src.next;
-            while ((block != queue.end()) && block->complete()
-                   && (block->sequence == next)
+            while ((block != queue.end())
                    && src.audioqueue.write_available() && src.infoqueue.write_available())
             {
+                if (!block->complete() || (block->sequence != next)){
+                    // the expected block is missing or incomplete.
+                    // try to recover it from the following block.
+                    if (recover_block(src, block, next)){
+                        if (block->sequence == next){
+                            count++; // pop incomplete block
+                            block++;
+                        }
+                        next++;
+                        continue;
+                    } else if (reliable_ && (block->sequence != next)){
+                        // the transport is ordered, so the missing blocks
+                        // will never arrive. skip them instead of waiting.
+                        LOG_VERBOSE("skipped missing blocks " << next
+                                    << " - " << (block->sequence - 1));
+                        next = block->sequence;
+                        continue;
+                    } else {
+                        break;
+                    }
+                }
+
                 LOG_DEBUG("write samples (" << block->sequence << ")");
 
                 auto ptr = src.audioqueue.write_data();
@@ -364,6 +526,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                 // push info
                 aoo::source_desc::info i;
                 i.sr = block->samplerate;
+                i.time = block->time;
                 i.channel = block->channel;
                 i.state = AOO_SOURCE_PLAY;
                 src.infoqueue.write(i);
@@ -405,12 +568,14 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
     #endif
 
         // deal with "holes" in block queue
-        if (!queue.empty()){
+        // (not necessary with a reliable transport)
+        if (!queue.empty() && !reliable_){
         #if LOGLEVEL >= 3
             std::cerr << queue << std::endl;
         #endif
             int32_t numframes = 0;
             retransmit_list_.clear();
+            auto interval = resend_interval(src);
 
             // resend incomplete blocks except for the last block
             LOG_DEBUG("resend incomplete blocks");
@@ -418,7 +583,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                 if (!it->complete()){
                     // insert ack (if needed)
                     auto& ack = acklist.get(it->sequence);
-                    if (ack.check(elapsedtime_.get(), resend_interval_ * 0.001)){
+                    if (ack.check(elapsedtime_.get(), interval)){
                         for (int i = 0; i < it->num_frames(); ++i){
                             if (!it->has_frame(i)){
                                 if (numframes < resend_maxnumframes_){
@@ -443,7 +608,7 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
                     for (int i = 0; i < missing; ++i){
                         // insert ack (if necessary)
                         auto& ack = acklist.get(next + i);
-                        if (ack.check(elapsedtime_.get(), resend_interval_ * 0.001)){
+                        if (ack.check(elapsedtime_.get(), interval)){
                             if (numframes + it->num_frames() <= resend_maxnumframes_){
                                 retransmit_list_.push_back(data_request { next + i, -1 }); // whole block
                                 numframes += it->num_frames();
@@ -484,9 +649,18 @@ void aoo_sink::handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
     #if LOGLEVEL >= 3
         std::cerr << acklist << std::endl;
     #endif
+
+        // ping source
+        if (ping_interval_ > 0){
+            auto now = aoo::time_tag(aoo_osctime_get()).to_double();
+            if ((now - src.lastping) >= ping_interval_ * 0.001){
+                send_ping(src, now);
+            }
+        }
     } else {
         // discard data and request format!
-        request_format(endpoint, fn, id);
+        // (a binary data message implies that the source understands flags)
+        request_format(endpoint, fn, id, (flags & AOO_FLAG_BINDATA) ? flags : -1);
     }
 }
 
@@ -494,8 +668,10 @@ void aoo_sink::update_source(aoo::source_desc &src){
     // resize audio ring buffer
     if (src.decoder && src.decoder->blocksize() > 0 && src.decoder->samplerate() > 0){
         LOG_DEBUG("update source");
-        // recalculate buffersize from ms to samples
-        double bufsize = (double)buffersize_ * src.decoder->samplerate() * 0.001;
+        // recalculate buffersize from ms to samples.
+        // with a playout delay, blocks must be able to wait in the buffer.
+        auto bufms = std::max<int32_t>(buffersize_, playout_delay_);
+        double bufsize = (double)bufms * src.decoder->samplerate() * 0.001;
         auto d = div(bufsize, src.decoder->blocksize());
         int32_t nbuffers = d.quot + (d.rem != 0); // round up
         nbuffers = std::max<int32_t>(1, nbuffers); // e.g. if buffersize_ is 0
@@ -509,6 +685,7 @@ void aoo_sink::update_source(aoo::source_desc &src){
             // push nominal samplerate + default channel (0)
             aoo::source_desc::info i;
             i.sr = src.decoder->samplerate();
+            i.time = 0;
             i.channel = 0;
             i.state = AOO_SOURCE_STOP;
             src.infoqueue.write(i);
@@ -520,6 +697,7 @@ void aoo_sink::update_source(aoo::source_desc &src){
         src.blockqueue.resize(nbuffers);
         src.newest = 0;
         src.next = -1;
+        src.transit = 0;
         src.channel = 0;
         src.samplerate = src.decoder->samplerate();
         src.ack_list.setup(resend_limit_);
@@ -530,24 +708,32 @@ void aoo_sink::update_source(aoo::source_desc &src){
     }
 }
 
-void aoo_sink::request_format(void *endpoint, aoo_replyfn fn, int32_t id){
+// /AoO/<src>/request <sink> [<flags>]
+
+void aoo_sink::request_format(void *endpoint, aoo_replyfn fn, int32_t id, int32_t flags){
     LOG_DEBUG("request format");
     char buf[AOO_MAXPACKETSIZE];
-    aoo::osc::message_builder msg(buf, sizeof(buf));
 
     // make OSC address pattern
     const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_REQUEST);
     char address[max_addr_size];
-    snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, id, AOO_REQUEST);
+    auto addrsize = snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, id, AOO_REQUEST);
 
-    msg.set(address, id_);
+    int32_t size;
+    if (flags >= 0){
+        size = aoo::request_message_flags::write(buf, sizeof(buf), address, addrsize, id_, flags);
+    } else {
+        // older sources don't accept flags
+        size = aoo::request_message::write(buf, sizeof(buf), address, addrsize, id_);
+    }
 
-    fn(endpoint, msg.data(), msg.size());
+    fn(endpoint, buf, size);
 }
 
+// /AoO/<src>/resend <sink> <salt> <seq0> <frame0> <seq1> <frame1> ...
+
 void aoo_sink::request_data(aoo::source_desc& src){
     char buf[AOO_MAXPACKETSIZE];
-    aoo::osc::message_builder msg(buf, sizeof(buf));
 
     // make OSC address pattern
     const int32_t maxaddrsize = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_RESEND);
@@ -558,20 +744,17 @@ void aoo_sink::request_data(aoo::source_desc& src){
     const int32_t maxrequests = maxdatasize / 10; // 2 * int32_t + overhead for typetags
     auto d = div(retransmit_list_.size(), maxrequests);
 
-    auto dorequest = [&](const data_request* data, int32_t n){
-        msg.set_address(address, addrsize);
-
-        int ntags = n * 2 + 2;
-        auto typetags = (char *)alloca(ntags);
-        memset(typetags, 'i', ntags);
-        msg.set_args(typetags, ntags);
+    static_assert(sizeof(data_request) == 2 * sizeof(int32_t), "bad data_request layout");
 
-        msg << id_ << src.salt;
-        for (int i = 0; i < n; ++i){
-            msg << data[i].sequence << data[i].frame;
+    auto dorequest = [&](const data_request* data, int32_t n){
+        aoo::osc::int32_list pairs(reinterpret_cast<const int32_t *>(data), n * 2);
+        auto size = aoo::resend_message::write(buf, sizeof(buf), address, addrsize,
+                                               id_, src.salt, pairs);
+        if (size > 0){
+            src.send(buf, size);
+        } else {
+            LOG_ERROR("invalid resend message");
         }
-
-        src.send(msg.data(), msg.size());
     };
 
     for (int i = 0; i < d.quot; ++i){
@@ -582,6 +765,145 @@ void aoo_sink::request_data(aoo::source_desc& src){
     }
 }
 
+// /AoO/<src>/ping <sink> <t1>
+
+void aoo_sink::send_ping(aoo::source_desc& src, double time){
+    char buf[AOO_MAXPACKETSIZE];
+    aoo::osc::message_builder msg(buf, sizeof(buf));
+
+    // make OSC address pattern
+    const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_PING);
+    char address[max_addr_size];
+    snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, src.id, AOO_PING);
+
+    aoo::osc::timetag t1 = aoo::time_tag(time).to_uint64();
+
+    msg.set(address, id_, t1);
+
+    src.send(msg.data(), msg.size());
+
+    src.lastping = time;
+}
+
+// /AoO/<src>/pong <sink> <t1> <t2>
+
+void aoo_sink::send_pong(void *endpoint, aoo_replyfn fn, int32_t id,
+                         uint64_t t1, uint64_t t2){
+    char buf[AOO_MAXPACKETSIZE];
+    aoo::osc::message_builder msg(buf, sizeof(buf));
+
+    // make OSC address pattern
+    const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_PONG);
+    char address[max_addr_size];
+    snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, id, AOO_PONG);
+
+    msg.set(address, id_, (aoo::osc::timetag)t1, (aoo::osc::timetag)t2);
+
+    fn(endpoint, msg.data(), msg.size());
+}
+
+// reconstruct a missing block from the (FEC) data of the following block
+// if a retransmission can't arrive before the block is due for playout.
+bool aoo_sink::recover_block(aoo::source_desc& src, aoo::block *block, int32_t seq){
+    if (!src.decoder->can_recover()){
+        return false;
+    }
+    // find the following block
+    auto& queue = src.blockqueue;
+    auto following = block;
+    if (following->sequence == seq){
+        following++;
+    }
+    if (following == queue.end() || following->sequence != (seq + 1)
+            || !following->complete()){
+        return false;
+    }
+    // check if we still have time to wait for the missing block
+    auto& audio = src.audioqueue;
+    double blocktime = (double)src.decoder->blocksize() / (double)src.decoder->samplerate();
+    double buffered = audio.read_available() * blocktime;
+    if (!reliable_ && resend_limit_ > 0 && buffered > resend_interval(src)){
+        return false;
+    }
+    LOG_VERBOSE("recover block " << seq);
+
+    auto ptr = audio.write_data();
+    auto nsamples = audio.blocksize();
+    if (src.decoder->recover(following->data(), following->size(), ptr, nsamples) <= 0){
+        // recovery failed - fill with zeros
+        std::fill(ptr, ptr + nsamples, 0);
+    }
+    audio.write_commit();
+
+    // push info
+    aoo::source_desc::info i;
+    i.sr = following->samplerate;
+    i.time = following->time > 0 ? following->time - blocktime : 0;
+    i.channel = following->channel;
+    i.state = AOO_SOURCE_PLAY;
+    src.infoqueue.write(i);
+
+    // don't request it anymore
+    src.ack_list.remove(seq);
+
+    return true;
+}
+
+double aoo_sink::resend_interval(const aoo::source_desc& src) const {
+    double interval = resend_interval_ * 0.001;
+    if (src.rtt.valid()){
+        // don't request a block again before the reply could have arrived
+        auto timeout = src.rtt.rtt() + 4 * src.rtt.jitter();
+        if (timeout > interval){
+            interval = timeout;
+        }
+    }
+    return interval;
+}
+
+int32_t aoo_sink_getsourceinfo(aoo_sink *sink, void *src, int32_t id, aoo_peer_info *info){
+    if (info){
+        return sink->get_source_info(src, id, *info);
+    } else {
+        return 0;
+    }
+}
+
+void aoo_sink_removesource(aoo_sink *sink, void *src, int32_t id) {
+    sink->remove_source(src, id);
+}
+
+void aoo_sink::remove_source(void *endpoint, int32_t id){
+    // the sources might be in use by process()
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto it = sources_.begin(); it != sources_.end(); ){
+        if ((it->endpoint == endpoint) && (id == AOO_ID_WILDCARD || it->id == id)){
+            // keep the decoder for new sources
+            decoder_pool_.put(std::move(it->decoder));
+            it = sources_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool aoo_sink::get_source_info(void *endpoint, int32_t id, aoo_peer_info& info){
+    // sources might be added concurrently by handle_message()
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto src = std::find_if(sources_.begin(), sources_.end(), [&](auto& s){
+        return (s.endpoint == endpoint) && (s.id == id);
+    });
+    if (src != sources_.end() && (src->rtt.valid() || src->transit != 0)){
+        info.rtt = src->rtt.rtt();
+        info.jitter = src->rtt.jitter();
+        info.offset = src->offset.get();
+        info.arrival_jitter = src->jitter;
+        return true;
+    } else {
+        return false;
+    }
+}
+
 #if AOO_DEBUG_RESAMPLING
 thread_local int32_t debug_counter = 0;
 #endif
@@ -608,7 +930,11 @@ int32_t aoo_sink::process(uint64_t t){
         dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
     } else {
         auto elapsed = tt.to_double() - starttime_;
+        bool locked = dll_.locked();
         dll_.update(elapsed);
+        if (!locked && dll_.locked()){
+            LOG_VERBOSE("sink time DLL locked after " << elapsed << " seconds");
+        }
     #if AOO_DEBUG_DLL
         DO_LOG("SINK");
         DO_LOG("elapsed: " << elapsed << ", period: " << dll_.period()
@@ -616,6 +942,10 @@ int32_t aoo_sink::process(uint64_t t){
     #endif
         elapsedtime_.set(elapsed);
     }
+    // current time (filtered by the time DLL)
+    double now = starttime_ + dll_.time();
+    // use the nominal samplerate until the DLL has converged
+    double dllsr = dll_.locked() ? dll_.samplerate() : samplerate_;
 
     // pre-allocate event array (max. 1 per source)
     aoo_event *events = (aoo_event *)alloca(sizeof(aoo_event) * AOO_MAXNUMEVENTS);
@@ -639,10 +969,48 @@ int32_t aoo_sink::process(uint64_t t){
                 DO_LOG("read available: " << src.audioqueue.read_available());
             }
         #endif
-            auto info = src.infoqueue.read();
+            auto info = *src.infoqueue.read_data(); // peek
+            int32_t onset = 0;
+            if (playout_delay_ > 0 && info.time > 0){
+                // schedule playout at <capture time> + <playout delay>.
+                // the capture time is translated from the source clock to
+                // our clock, so that all sinks share the same timeline.
+                // without a clock offset estimate we assume synchronized clocks.
+                // the samples in the resampler will be played before this block.
+                double deadline = info.time - src.offset.get() + playout_delay_ * 0.001;
+                double playtime = now + src.resampler.balance()
+                        / (double)(nchannels * sr);
+                double diff = deadline - playtime;
+                // align on (re)start or if we're off by more than one block
+                if (src.laststate != AOO_SOURCE_PLAY
+                        || std::abs(diff) > src.decoder->blocksize() / sr){
+                    int32_t frames = std::lround(diff * sr);
+                    if (frames > 0){
+                        // too early: pad with silence
+                        int32_t nzeros = frames * nchannels;
+                        if (src.resampler.write_available() >= (nzeros + nsamples)){
+                            src.resampler.write_zeros(nzeros);
+                        } else if (src.audioqueue.write_available()){
+                            break; // wait
+                        } else {
+                            LOG_VERBOSE("buffer too small for playout delay");
+                        }
+                    } else if (frames < 0){
+                        // too late: skip samples
+                        onset = -frames * nchannels;
+                        if (onset >= nsamples){
+                            LOG_VERBOSE("drop late block");
+                            src.infoqueue.read();
+                            src.audioqueue.read_commit();
+                            continue;
+                        }
+                    }
+                }
+            }
+            src.infoqueue.read();
             src.channel = info.channel;
             src.samplerate = info.sr;
-            src.resampler.write(src.audioqueue.read_data(), nsamples);
+            src.resampler.write(src.audioqueue.read_data() + onset, nsamples - onset);
             src.audioqueue.read_commit();
             // check state
             if (info.state != src.laststate && numevents < AOO_MAXNUMEVENTS){
@@ -656,7 +1024,7 @@ int32_t aoo_sink::process(uint64_t t){
             }
         }
         // update resampler
-        src.resampler.update(src.samplerate, dll_.samplerate());
+        src.resampler.update(src.samplerate, dllsr);
         // read samples from resampler
         auto readsamples = blocksize_ * nchannels;
         if (src.resampler.read_available() >= readsamples){
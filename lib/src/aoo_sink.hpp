@@ -28,12 +28,19 @@ struct source_desc {
     lfqueue<aoo_sample> audioqueue;
     struct info {
         double sr;
+        double time; // capture time (0: unknown)
         int32_t channel;
         aoo_source_state state;
     };
     lfqueue<info> infoqueue;
     aoo_source_state laststate;
     dynamic_resampler resampler;
+    rtt_estimator rtt;
+    clock_offset offset;
+    double lastping = 0;
+    double transit = 0; // relative transit time of the most recent block (0: unknown)
+    double jitter = 0; // interarrival jitter (RFC 3550)
+    bool bindata = false; // we have accepted binary data messages
     // methods
     void send(const char *data, int32_t n);
 };
@@ -50,7 +57,14 @@ class aoo_sink final : public aoo::isink {
     int32_t handle_message(const char *data, int32_t n,
                            void *endpoint, aoo_replyfn fn) override;
 
+    int32_t handle_message(const char *data, int32_t n,
+                           void *endpoint, aoo_replyfn fn, uint64_t t) override;
+
     int32_t process(uint64_t t) override;
+
+    void remove_source(void *src, int32_t id) override;
+
+    bool get_source_info(void *src, int32_t id, aoo_peer_info& info) override;
  private:
     const int32_t id_;
     int32_t nchannels_ = 0;
@@ -61,10 +75,14 @@ class aoo_sink final : public aoo::isink {
     int32_t resend_interval_ = 0;
     int32_t resend_maxnumframes_ = 0;
     int32_t resend_packetsize_ = 0;
+    int32_t playout_delay_ = 0;
+    int32_t ping_interval_ = 0;
+    bool reliable_ = false;
     std::vector<aoo_sample> buffer_;
     aoo_processfn processfn_ = nullptr;
     void *user_ = nullptr;
     std::vector<aoo::source_desc> sources_;
+    aoo::codec_pool<aoo::decoder> decoder_pool_;
     struct data_request {
         int32_t sequence;
         int32_t frame;
@@ -78,14 +96,25 @@ class aoo_sink final : public aoo::isink {
     // helper methods
     void update_source(aoo::source_desc& src);
 
-    void request_format(void * endpoint, aoo_replyfn fn, int32_t id);
+    void request_format(void * endpoint, aoo_replyfn fn, int32_t id, int32_t flags = -1);
 
     void request_data(aoo::source_desc& src);
 
+    void send_ping(aoo::source_desc& src, double time);
+
+    void send_pong(void *endpoint, aoo_replyfn fn, int32_t id,
+                   uint64_t t1, uint64_t t2);
+
+    double resend_interval(const aoo::source_desc& src) const;
+
+    bool recover_block(aoo::source_desc& src, aoo::block *block, int32_t seq);
+
     void handle_format_message(void *endpoint, aoo_replyfn fn,
-                               int32_t id, int32_t salt, const aoo_format& f,
-                               const char *setting, int32_t size);
+                               int32_t id, int32_t salt, const aoo::codec& codec,
+                               const aoo_format& f, const char *setting, int32_t size,
+                               int32_t flags);
 
     void handle_data_message(void *endpoint, aoo_replyfn fn, int32_t id,
-                             int32_t salt, const aoo::data_packet& d);
+                             int32_t salt, const aoo::data_packet& d, double arrival,
+                             int32_t flags);
 };
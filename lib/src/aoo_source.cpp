@@ -8,10 +8,20 @@
 
 /*//////////////////// AoO source /////////////////////*/
 
-#define AOO_DATA_HEADERSIZE 80
+#define AOO_DATA_HEADERSIZE 88
 // address pattern string: max 32 bytes
 // typetag string: max. 12 bytes
-// args (without blob data): 36 bytes
+// args (without blob data): 44 bytes
+
+#define AOO_BUNDLE_HEADERSIZE 16
+// "#bundle" string: 8 bytes
+// time tag: 8 bytes
+
+// a sink which keeps sending plain /request messages for this long
+// after we have offered /format flags probably doesn't understand them.
+#define AOO_FLAGS_TIMEOUT 0.5
+// offer the flags again to such sinks in this interval (in seconds)
+#define AOO_FLAGS_RETRY 5.0
 
 namespace aoo {
 
@@ -47,18 +57,24 @@ void aoo_source_setformat(aoo_source *src, aoo_format *f) {
 void aoo_source::set_format(aoo_format &f){
     salt_ = make_salt();
 
-    if (!encoder_ || strcmp(encoder_->name(), f.codec)){
-        auto codec = aoo::find_codec(f.codec);
-        if (codec){
-            encoder_ = codec->create_encoder();
-        } else {
-            LOG_ERROR("codec '" << f.codec << "' not supported!");
-            return;
-        }
-        if (!encoder_){
-            LOG_ERROR("couldn't create encoder!");
-            return;
+    auto codec = aoo::find_codec(f.codec);
+    if (!codec){
+        LOG_ERROR("codec '" << f.codec << "' not supported!");
+        return;
+    }
+    // reuse the current encoder if possible; otherwise try
+    // the pool before creating a new instance.
+    if (!encoder_ || encoder_->id() != codec->id()){
+        auto encoder = encoder_pool_.take(codec->id());
+        if (!encoder){
+            encoder = codec->create_encoder();
+            if (!encoder){
+                LOG_ERROR("couldn't create encoder!");
+                return;
+            }
         }
+        encoder_pool_.put(std::move(encoder_));
+        encoder_ = std::move(encoder);
     }
     encoder_->setup(f);
 
@@ -67,6 +83,7 @@ void aoo_source::set_format(aoo_format &f){
     for (auto& sink : sinks_){
         send_format(sink);
     }
+    flush_bundles();
 }
 
 void aoo_source_setup(aoo_source *src, aoo_source_settings *settings){
@@ -81,6 +98,14 @@ void aoo_source::setup(aoo_source_settings &settings){
     samplerate_ = settings.samplerate;
     buffersize_ = std::max<int32_t>(settings.buffersize, 0);
     resend_buffersize_ = std::max<int32_t>(settings.resend_buffersize, 0);
+    ping_interval_ = std::max<int32_t>(settings.ping_interval, 0);
+    if (bundle_ && !settings.bundle){
+        flush_bundles();
+    }
+    bundle_ = settings.bundle != 0;
+    bool binary = settings.binary != 0;
+    bool changed = binary != binary_;
+    binary_ = binary;
 
     // packet size
     const int32_t minpacketsize = AOO_DATA_HEADERSIZE + 64;
@@ -98,8 +123,20 @@ void aoo_source::setup(aoo_source_settings &settings){
     bandwidth_ = settings.time_filter_bandwidth;
     starttime_ = 0; // will update
 
+    // pre-build encoders, so that switching codecs doesn't have to allocate
+    encoder_pool_.fill(encoder_ ? encoder_->id() : -1, [](const aoo::codec& c){
+        return c.create_encoder();
+    });
+
     if (encoder_){
         update();
+        if (changed){
+            // (re)negotiate binary data messages
+            for (auto& sink : sinks_){
+                send_format(sink);
+            }
+            flush_bundles();
+        }
     }
 }
 
@@ -114,7 +151,7 @@ void aoo_source::update(){
             int32_t nbuffers = d.quot + (d.rem != 0); // round up
             nbuffers = std::max<int32_t>(nbuffers, 1); // need at least 1 buffer!
             audioqueue_.resize(nbuffers * nsamples, nsamples);
-            srqueue_.resize(nbuffers, 1);
+            infoqueue_.resize(nbuffers, 1);
             LOG_DEBUG("aoo_source::update: nbuffers = " << nbuffers);
         }
         // setup resampler
@@ -149,9 +186,9 @@ void aoo_source::add_sink(void *sink, int32_t id, aoo_replyfn fn){
         return (s.endpoint == sink) && (s.id == id);
     });
     if (result == sinks_.end()){
-        sink_desc sd = { sink, fn, id, 0 };
-        sinks_.push_back(sd);
-        send_format(sd);
+        sinks_.emplace_back(sink, fn, id);
+        send_format(sinks_.back());
+        flush_bundle(sinks_.back());
     } else {
         LOG_WARNING("aoo_source::add_sink: sink already added!");
     }
@@ -216,25 +253,62 @@ void aoo_source::set_sink_channel(void *sink, int32_t id, int32_t chn){
     }
 }
 
+int32_t aoo_source_getsinkinfo(aoo_source *src, void *sink, int32_t id, aoo_peer_info *info){
+    if (info){
+        return src->get_sink_info(sink, id, *info);
+    } else {
+        return 0;
+    }
+}
+
+bool aoo_source::get_sink_info(void *sink, int32_t id, aoo_peer_info& info){
+    auto s = find_sink(sink, id);
+    if (s && s->rtt.valid()){
+        info.rtt = s->rtt.rtt();
+        info.jitter = s->rtt.jitter();
+        info.offset = s->offset.get();
+        info.arrival_jitter = 0;
+        return true;
+    } else {
+        return false;
+    }
+}
+
 void aoo_source_handlemessage(aoo_source *src, const char *data, int32_t n,
                               void *sink, aoo_replyfn fn) {
     src->handle_message(data, n, sink, fn);
 }
 
-// /AoO/<src>/request <sink>
+// /AoO/<src>/request <sink> [<flags>]
+// /AoO/<src>/resend <sink> <salt> <seq0> <frame0> <seq1> <frame1> ...
+// /AoO/<src>/ping <sink> <t1>
+// /AoO/<src>/pong <sink> <t1> <t2>
 void aoo_source::handle_message(const char *data, int32_t n, void *endpoint, aoo_replyfn fn){
+    handle_packet(data, n, endpoint, fn);
+    // send pending replies (e.g. resent blocks)
+    flush_bundles();
+}
+
+void aoo_source::handle_packet(const char *data, int32_t n, void *endpoint, aoo_replyfn fn){
     aoo::osc::received_packet packet(data, n);
 
     if (packet.is_bundle()){
-        LOG_WARNING("OSC bundles are not supported (yet)");
+        aoo::osc::received_bundle bundle(packet);
+        if (!bundle.check()){
+            LOG_ERROR("received malformed OSC bundle!");
+            return;
+        }
+        // the elements are handled immediately (time tag is ignored)
+        for (auto elem : bundle){
+            handle_packet(elem.data(), elem.size(), endpoint, fn);
+        }
         return;
     }
 
-    aoo::osc::received_message msg(packet);
-
+    // check the address pattern before parsing the arguments
     int32_t src = 0;
-    auto onset = aoo_parsepattern(data, n, &src);
-    if (!onset){
+    auto type = aoo_parsemessage(data, n, &src);
+    if (type == AOO_MSG_NONE){
         LOG_WARNING("not an AoO message!");
         return;
     }
@@ -243,24 +317,49 @@ void aoo_source::handle_message(const char *data, int32_t n, void *endpoint, aoo
         return;
     }
 
-    if (!strcmp(msg.address_pattern() + onset, AOO_REQUEST)){
-        if (msg.count() == 1){
+    aoo::osc::received_message msg(packet);
+
+    if (type == AOO_MSG_REQUEST){
+        if (msg.count() == 1 || msg.count() == 2){
             auto it = msg.begin();
-            auto id = it->as_int32();
+            auto id = (it++)->as_int32();
+            // older sinks don't send flags
+            auto flags = (msg.count() > 1) ? (it++)->as_int32() : -1;
+            auto update_flags = [&](sink_desc& s){
+                if (flags >= 0){
+                    s.binary = (flags & AOO_FLAG_BINDATA) != 0;
+                    s.legacy = false;
+                    s.flagtime = 0;
+                } else if (!s.binary && !s.legacy && s.flagtime > 0){
+                    // a plain /request doesn't prove anything by itself, the sink
+                    // might just have missed our /format message (e.g. dropped
+                    // packet or not set up yet). only if it keeps asking, it
+                    // probably rejects the flags.
+                    auto now = aoo::time_tag(aoo_osctime_get()).to_double();
+                    if ((now - s.flagtime) > AOO_FLAGS_TIMEOUT){
+                        LOG_VERBOSE("sink " << s.id << " doesn't accept /format flags");
+                        s.legacy = true;
+                        s.flagtime = 0;
+                        s.lastprobe = now;
+                    }
+                }
+            };
             auto sink = std::find_if(sinks_.begin(), sinks_.end(), [&](auto& s){
                 return (s.endpoint == endpoint) && (s.id == id);
             });
             if (sink != sinks_.end()){
+                update_flags(*sink);
                 // just resend format (the last format message might have been lost)
                 send_format(*sink);
             } else {
                 // add new sink
                 add_sink(endpoint, id, fn);
+                update_flags(sinks_.back());
             }
         } else {
             LOG_ERROR("wrong number of arguments for /request message");
         }
-    } else if (!strcmp(msg.address_pattern() + onset, AOO_RESEND)){
+    } else if (type == AOO_MSG_RESEND){
         if (!history_.capacity()){
             return;
         }
@@ -290,6 +389,7 @@ void aoo_source::handle_message(const char *data, int32_t n, void *endpoint, aoo
                 if (block){
                     aoo::data_packet d;
                     d.sequence = block->sequence;
+                    d.time = block->time;
                     d.samplerate = block->samplerate;
                     d.totalsize = block->size();
                     d.nframes = block->num_frames();
@@ -313,8 +413,37 @@ void aoo_source::handle_message(const char *data, int32_t n, void *endpoint, aoo
         } else {
             LOG_ERROR("bad number of arguments for /resend message");
         }
+    } else if (type == AOO_MSG_PING){
+        if (msg.count() == 2){
+            auto it = msg.begin();
+            auto id = (it++)->as_int32();
+            auto t1 = (it++)->as_timetag();
+            // reply immediately
+            send_pong(endpoint, fn, id, t1, aoo_osctime_get());
+        } else {
+            LOG_ERROR("wrong number of arguments for /ping message");
+        }
+    } else if (type == AOO_MSG_PONG){
+        if (msg.count() == 3){
+            auto t4 = aoo::time_tag(aoo_osctime_get()).to_double();
+            auto it = msg.begin();
+            auto id = (it++)->as_int32();
+            auto t1 = aoo::time_tag((it++)->as_timetag()).to_double();
+            auto t2 = aoo::time_tag((it++)->as_timetag()).to_double();
+            auto sink = find_sink(endpoint, id);
+            if (sink){
+                sink->rtt.update(t4 - t1);
+                sink->offset.update(t1, t2, t4);
+                LOG_DEBUG("aoo_source: sink " << id << " rtt = " << sink->rtt.rtt()
+                          << ", jitter = " << sink->rtt.jitter());
+            } else {
+                LOG_VERBOSE("ignoring '/pong' message: sink not found");
+            }
+        } else {
+            LOG_ERROR("wrong number of arguments for /pong message");
+        }
     } else {
-        LOG_WARNING("unknown message '" << (msg.address_pattern() + onset) << "'");
+        LOG_WARNING("unknown message '" << msg.address_pattern() << "'");
     }
 }
 
@@ -327,12 +456,14 @@ bool aoo_source::send(){
         return false;
     }
 
-    if (audioqueue_.read_available() && srqueue_.read_available()){
+    if (audioqueue_.read_available() && infoqueue_.read_available()){
         const auto nchannels = encoder_->nchannels();
         const auto blocksize = encoder_->blocksize();
+        auto info = infoqueue_.read();
         aoo::data_packet d;
         d.sequence = sequence_;
-        d.samplerate = srqueue_.read();
+        d.time = info.time;
+        d.samplerate = info.sr;
 
         // copy and convert audio samples to blob data
         const auto blobmaxsize = sizeof(double) * nchannels * blocksize; // overallocate
@@ -346,11 +477,11 @@ bool aoo_source::send(){
         d.nframes = dv.quot + (dv.rem != 0);
 
         // save block
-        history_.push(d.sequence, d.samplerate,
+        history_.push(d.sequence, d.time, d.samplerate,
                       blobdata, d.totalsize, d.nframes, maxpacketsize);
 
         // send a single frame to all sink
-        // /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
+        // /AoO/<sink>/data <src> <salt> <seq> <time> <sr> <channel_onset> <totalsize> <numpackets> <packetnum> <data>
         auto dosend = [&](int32_t frame, const char* data, auto n){
             d.framenum = frame;
             d.data = data;
@@ -381,6 +512,34 @@ bool aoo_source::send(){
         return true;
     } else {
         // LOG_DEBUG("couldn't send");
+        // nothing else to do - check if we should ping the sinks
+        if (ping_interval_ > 0){
+            auto now = aoo::time_tag(aoo_osctime_get()).to_double();
+            for (auto& sink : sinks_){
+                if ((now - sink.lastping) >= ping_interval_ * 0.001){
+                    send_ping(sink, now);
+                }
+            }
+        }
+        // offer binary data messages again to sinks which didn't accept them,
+        // they might have missed our /format messages. sinks which really
+        // don't understand the flags just ignore the message.
+        if (binary_){
+            double now = 0;
+            for (auto& sink : sinks_){
+                if (sink.legacy){
+                    if (!now){
+                        now = aoo::time_tag(aoo_osctime_get()).to_double();
+                    }
+                    if ((now - sink.lastprobe) >= AOO_FLAGS_RETRY){
+                        send_format(sink, true);
+                        sink.lastprobe = now;
+                    }
+                }
+            }
+        }
+        // send pending messages
+        flush_bundles();
         return false;
     }
 }
@@ -398,7 +557,11 @@ bool aoo_source::process(const aoo_sample **data, int32_t n, uint64_t t){
         dll_.setup(samplerate_, blocksize_, bandwidth_, 0);
     } else {
         auto elapsed = tt.to_double() - starttime_;
+        bool locked = dll_.locked();
         dll_.update(elapsed);
+        if (!locked && dll_.locked()){
+            LOG_VERBOSE("source time DLL locked after " << elapsed << " seconds");
+        }
     #if AOO_DEBUG_DLL
         fprintf(stderr, "SOURCE\n");
         // fprintf(stderr, "timetag: %llu, seconds: %f\n", tt.to_uint64(), tt.to_double());
@@ -412,6 +575,11 @@ bool aoo_source::process(const aoo_sample **data, int32_t n, uint64_t t){
         return false;
     }
 
+    // capture time of the current block (filtered by the time DLL)
+    double now = starttime_ + dll_.time();
+    // use the nominal samplerate until the DLL has converged
+    double sr = dll_.locked() ? dll_.samplerate() : samplerate_;
+
     // non-interleaved -> interleaved
     auto insamples = blocksize_ * nchannels_;
     auto outsamples = encoder_->blocksize() * nchannels_;
@@ -431,27 +599,33 @@ bool aoo_source::process(const aoo_sample **data, int32_t n, uint64_t t){
         }
         while (resampler_.read_available() >= outsamples
                && audioqueue_.write_available()
-               && srqueue_.write_available())
+               && infoqueue_.write_available())
         {
+            // the oldest sample in the resampler precedes the current block
+            // by the amount of buffered samples (minus the current block).
+            double buffered = (double)resampler_.read_available()
+                    / (double)(nchannels_ * encoder_->samplerate());
+            double time = now + (double)n / (double)samplerate_ - buffered;
+
             // copy audio samples
             resampler_.read(audioqueue_.write_data(), audioqueue_.blocksize());
             audioqueue_.write_commit();
 
-            // push samplerate
+            // push samplerate + capture time
             auto ratio = (double)encoder_->samplerate() / (double)samplerate_;
-            srqueue_.write(dll_.samplerate() * ratio);
+            infoqueue_.write(block_info { sr * ratio, time });
         }
 
         return true;
     } else {
         // bypass resampler
-        if (audioqueue_.write_available() && srqueue_.write_available()){
+        if (audioqueue_.write_available() && infoqueue_.write_available()){
             // copy audio samples
             std::copy(buf, buf + outsamples, audioqueue_.write_data());
             audioqueue_.write_commit();
 
-            // push samplerate
-            srqueue_.write(dll_.samplerate());
+            // push samplerate + capture time
+            infoqueue_.write(block_info { sr, now });
 
             return true;
         } else {
@@ -461,86 +635,226 @@ bool aoo_source::process(const aoo_sample **data, int32_t n, uint64_t t){
     }
 }
 
-// /AoO/<sink>/data <src> <salt> <seq> <sr> <channel_onset> <totalsize> <nframes> <frame> <data>
+// /AoO/<sink>/data <src> <salt> <seq> <time> <sr> <channel_onset> <totalsize> <nframes> <frame> <data>
 
 void aoo_source::send_data(sink_desc& sink, const aoo::data_packet& d){
     assert(d.data != nullptr);
 
     char buf[AOO_MAXPACKETSIZE];
-    aoo::osc::message_builder msg(buf, sizeof(buf));
+
+    if (binary_ && sink.binary){
+        aoo::data_packet bd = d;
+        bd.channel = sink.channel;
+        auto size = aoo::write_binary_data(buf, sizeof(buf), sink.id, id_, salt_, bd);
+        if (size > 0){
+            send_message(sink, buf, size);
+        } else {
+            LOG_ERROR("invalid binary data message");
+        }
+        return;
+    }
 
     const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_DATA);
     char address[max_addr_size];
     const char *addr;
+    int32_t addrsize;
     if (sink.id != AOO_ID_WILDCARD){
-        snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, sink.id, AOO_DATA);
+        addrsize = snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, sink.id, AOO_DATA);
         addr = address;
     } else {
         addr = AOO_DATA_WILDCARD;
+        addrsize = sizeof(AOO_DATA_WILDCARD) - 1;
     }
 
-    msg.set(addr, id_, salt_, d.sequence, d.samplerate, sink.channel,
-            d.totalsize, d.nframes, d.framenum, aoo::osc::blob(d.data, d.size));
+    aoo::osc::timetag time = aoo::time_tag(d.time).to_uint64();
+
+    auto size = aoo::data_message::write(buf, sizeof(buf), addr, addrsize,
+                                         id_, salt_, d.sequence, time, d.samplerate, sink.channel,
+                                         d.totalsize, d.nframes, d.framenum, aoo::osc::blob(d.data, d.size));
 
-    if (!msg.valid()){
+    if (!size){
         LOG_ERROR("invalid data message");
         return;
     } else {
     #if 0
         std::cerr << "send data message:\n";
-        for (int i = 0; i < msg.size(); ++i){
-            std::cerr << (int)(uint8_t)msg.data()[i] << " ";
+        for (int i = 0; i < size; ++i){
+            std::cerr << (int)(uint8_t)buf[i] << " ";
         }
         std::cerr << std::endl;
     #endif
     }
 
-    sink.send(msg.data(), msg.size());
+    send_message(sink, buf, size);
 
-    LOG_DEBUG("send block: seq = " << d.sequence << ", sr = " << d.samplerate
+    LOG_DEBUG("send block: seq = " << d.sequence << ", time = " << d.time << ", sr = " << d.samplerate
               << ", chn = " << sink.channel << ", totalsize = " << d.totalsize
               << ", nframes = " << d.nframes << ", frame = " << d.framenum << ", size " << d.size);
 }
 
-// /AoO/<sink>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <options...>
+// /AoO/<sink>/format <src> <salt> <numchannels> <samplerate> <blocksize> <codec> <options...> [<flags>]
 
-void aoo_source::send_format(sink_desc &sink){
+void aoo_source::send_format(sink_desc &sink, bool probe){
     if (encoder_){
         char buf[AOO_MAXPACKETSIZE];
-        aoo::osc::message_builder msg(buf, sizeof(buf));
 
         const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_FORMAT);
         char address[max_addr_size];
         const char *addr;
+        int32_t addrsize;
         if (sink.id != AOO_ID_WILDCARD){
-            snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, sink.id, AOO_FORMAT);
+            addrsize = snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, sink.id, AOO_FORMAT);
             addr = address;
         } else {
             addr = AOO_FORMAT_WILDCARD;
+            addrsize = sizeof(AOO_FORMAT_WILDCARD) - 1;
         }
 
         auto settings = (char *)alloca(AOO_CODEC_MAXSETTINGSIZE);
         int32_t nchannels, samplerate, blocksize;
         auto setsize = encoder_->write(nchannels, samplerate, blocksize, settings, AOO_CODEC_MAXSETTINGSIZE);
 
-        msg.set(addr, id_, salt_, nchannels, samplerate, blocksize, encoder_->name(),
-                aoo::osc::blob(settings, setsize));
+        int32_t size;
+        if (binary_ && (!sink.legacy || probe)){
+            // offer binary data messages
+            if (!sink.flagtime && !sink.legacy){
+                sink.flagtime = aoo::time_tag(aoo_osctime_get()).to_double();
+            }
+            size = aoo::format_message_flags::write(buf, sizeof(buf), addr, addrsize,
+                                                    id_, salt_, nchannels, samplerate, blocksize, encoder_->id(),
+                                                    aoo::osc::blob(settings, setsize), AOO_FLAG_BINDATA);
+        } else {
+            size = aoo::format_message::write(buf, sizeof(buf), addr, addrsize,
+                                              id_, salt_, nchannels, samplerate, blocksize, encoder_->id(),
+                                              aoo::osc::blob(settings, setsize));
+        }
 
-        if (!msg.valid()){
+        if (!size){
             LOG_ERROR("invalid format message");
             return;
         } else {
         #if 0
             std::cerr << "send format message:\n";
-            for (int i = 0; i < msg.size(); ++i){
-                std::cerr << (int)(uint8_t)msg.data()[i] << " ";
+            for (int i = 0; i < size; ++i){
+                std::cerr << (int)(uint8_t)buf[i] << " ";
             }
             std::cerr << std::endl;
         #endif
         }
 
-        sink.send(msg.data(), msg.size());
+        send_message(sink, buf, size);
+    }
+}
+
+// /AoO/<sink>/ping <src> <t1>
+
+void aoo_source::send_ping(sink_desc& sink, double time){
+    char buf[AOO_MAXPACKETSIZE];
+    aoo::osc::message_builder msg(buf, sizeof(buf));
+
+    const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_PING);
+    char address[max_addr_size];
+    const char *addr;
+    if (sink.id != AOO_ID_WILDCARD){
+        snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, sink.id, AOO_PING);
+        addr = address;
+    } else {
+        addr = AOO_PING_WILDCARD;
+    }
+
+    aoo::osc::timetag t1 = aoo::time_tag(time).to_uint64();
+
+    msg.set(addr, id_, t1);
+
+    send_message(sink, msg.data(), msg.size());
+
+    sink.lastping = time;
+}
+
+// /AoO/<sink>/pong <src> <t1> <t2>
+
+void aoo_source::send_pong(void *endpoint, aoo_replyfn fn, int32_t id,
+                           uint64_t t1, uint64_t t2){
+    char buf[AOO_MAXPACKETSIZE];
+    aoo::osc::message_builder msg(buf, sizeof(buf));
+
+    const int32_t max_addr_size = sizeof(AOO_DOMAIN) + 16 + sizeof(AOO_PONG);
+    char address[max_addr_size];
+    snprintf(address, sizeof(address), "%s/%d%s", AOO_DOMAIN, id, AOO_PONG);
+
+    msg.set(address, id_, (aoo::osc::timetag)t1, (aoo::osc::timetag)t2);
+
+    fn(endpoint, msg.data(), msg.size());
+}
+
+// #bundle <timetag> [<size> <message>]...
+
+void aoo_source::send_message(sink_desc& sink, const char *data, int32_t n){
+    if (!bundle_){
+        sink.send(data, n);
+        return;
+    }
+    if (n & 3){
+        // not a valid bundle element (e.g. binary /data message);
+        // send it directly, but keep the order of messages.
+        flush_bundle(sink);
+        sink.send(data, n);
+        return;
+    }
+    auto elemsize = n + 4;
+    if ((int32_t)sink.bundle.size() + elemsize > packetsize_){
+        flush_bundle(sink);
+    }
+    if (AOO_BUNDLE_HEADERSIZE + elemsize > packetsize_){
+        // doesn't fit into a bundle
+        sink.send(data, n);
+        return;
+    }
+    auto onset = sink.bundle.size();
+    if (!onset){
+        // "#bundle" + time tag (1 = immediately)
+        sink.bundle.resize(AOO_BUNDLE_HEADERSIZE);
+        memcpy(sink.bundle.data(), "#bundle", 8);
+        aoo::to_bytes<uint64_t>(1, sink.bundle.data() + 8);
+        onset = AOO_BUNDLE_HEADERSIZE;
+    }
+    sink.bundle.resize(onset + elemsize);
+    aoo::to_bytes<int32_t>(n, sink.bundle.data() + onset);
+    memcpy(sink.bundle.data() + onset + 4, data, n);
+    sink.nbundled++;
+}
+
+void aoo_source::flush_bundle(sink_desc& sink){
+    if (sink.nbundled > 1){
+        sink.send(sink.bundle.data(), sink.bundle.size());
+    } else if (sink.nbundled == 1){
+        // send single message without bundle header
+        const int32_t onset = AOO_BUNDLE_HEADERSIZE + 4;
+        sink.send(sink.bundle.data() + onset, sink.bundle.size() - onset);
+    }
+    sink.bundle.clear();
+    sink.nbundled = 0;
+}
+
+void aoo_source::flush_bundles(){
+    for (auto& sink : sinks_){
+        flush_bundle(sink);
+    }
+}
+
+aoo_source::sink_desc * aoo_source::find_sink(void *endpoint, int32_t id){
+    sink_desc *wildcard = nullptr;
+    for (auto& s : sinks_){
+        if (s.endpoint == endpoint){
+            if (s.id == id){
+                return &s;
+            } else if (s.id == AOO_ID_WILDCARD){
+                wildcard = &s;
+            }
+        }
     }
+    // e.g. pong from a sink which has been addressed with a wildcard
+    return wildcard;
 }
 
 int32_t aoo_source::make_salt(){
@@ -22,6 +22,8 @@ class aoo_source final : public aoo::isource {
 
     void set_sink_channel(void *sink, int32_t id, int32_t chn) override;
 
+    bool get_sink_info(void *sink, int32_t id, aoo_peer_info& info) override;
+
     void handle_message(const char *data, int32_t n, void *endpoint, aoo_replyfn fn) override;
 
     bool send() override;
@@ -31,27 +33,46 @@ class aoo_source final : public aoo::isource {
     const int32_t id_;
     int32_t salt_ = 0;
     std::unique_ptr<aoo::encoder> encoder_;
+    aoo::codec_pool<aoo::encoder> encoder_pool_;
     int32_t nchannels_ = 0;
     int32_t blocksize_ = 0;
     int32_t samplerate_ = 0;
     int32_t buffersize_ = 0;
     int32_t packetsize_ = AOO_DEFPACKETSIZE;
     int32_t resend_buffersize_ = 0;
+    int32_t ping_interval_ = 0;
+    bool bundle_ = false;
+    bool binary_ = false;
     int32_t sequence_ = 0;
     aoo::dynamic_resampler resampler_;
     aoo::lfqueue<aoo_sample> audioqueue_;
-    aoo::lfqueue<double> srqueue_;
+    struct block_info {
+        double sr;
+        double time;
+    };
+    aoo::lfqueue<block_info> infoqueue_;
     aoo::time_dll dll_;
     double bandwidth_ = AOO_DLL_BW;
     double starttime_ = 0;
     aoo::history_buffer history_;
     // sinks
     struct sink_desc {
+        sink_desc(void *_endpoint, aoo_replyfn _fn, int32_t _id)
+            : endpoint(_endpoint), fn(_fn), id(_id), channel(0) {}
         // data
         void *endpoint;
         aoo_replyfn fn;
         int32_t id;
         int32_t channel;
+        aoo::rtt_estimator rtt;
+        aoo::clock_offset offset;
+        double lastping = 0;
+        bool binary = false; // sink accepts binary /data messages
+        bool legacy = false; // sink doesn't understand /format flags
+        double flagtime = 0; // first unanswered /format with flags
+        double lastprobe = 0; // last time we offered flags to a legacy sink
+        std::vector<char> bundle; // pending OSC bundle
+        int32_t nbundled = 0;
         // methods
         void send(const char *data, int32_t n){
             fn(endpoint, data, n);
@@ -60,7 +81,15 @@ class aoo_source final : public aoo::isource {
     std::vector<sink_desc> sinks_;
     // helper methods
     void update();
+    void handle_packet(const char *data, int32_t n, void *endpoint, aoo_replyfn fn);
+    void send_message(sink_desc& sink, const char *data, int32_t n);
+    void flush_bundle(sink_desc& sink);
+    void flush_bundles();
     void send_data(sink_desc& sink, const aoo::data_packet& d);
-    void send_format(sink_desc& sink);
+    void send_format(sink_desc& sink, bool probe = false);
+    void send_ping(sink_desc& sink, double time);
+    void send_pong(void *endpoint, aoo_replyfn fn, int32_t id,
+                   uint64_t t1, uint64_t t2);
+    sink_desc * find_sink(void *endpoint, int32_t id);
     int32_t make_salt();
 };
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <limits>
+#include <algorithm>
+#include <cmath>
 #include <stdio.h>
+#include <stdint.h>
 
 // Delay-Locked-Loop as described by Fons Adriaensen in
 // "Using a DLL to filter time"
@@ -9,6 +12,13 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+// max. relative standard error of the period estimate to be considered locked
+#ifndef AOO_DLL_LOCK_TOLERANCE
+#define AOO_DLL_LOCK_TOLERANCE 0.0001
+#endif
+// min. number of periods before we can lock
+#define AOO_DLL_LOCK_MINPERIODS 100
+
 namespace aoo {
 
 class time_dll {
@@ -16,10 +26,20 @@ public:
     void setup(double sr, int nper, double bandwidth, double t){
         double tper = nper / sr;
         nper_ = nper;
+        tper_ = tper;
         // compute coefficients
         double omega = 2 * M_PI * bandwidth * (nper / sr);
-        b_ = omega * 1.4142135623731; // omega * sqrt(2)
-        c_ = omega * omega;
+        bt_ = omega * 1.4142135623731; // omega * sqrt(2)
+        ct_ = omega * omega;
+        // start wide open and shift down to the target bandwidth
+        // with the gains of a growing memory filter, so that the
+        // estimate follows a least squares fit over all periods so far.
+        b_ = 1;
+        c_ = 0;
+        count_ = 0;
+        var_ = 0;
+        shifting_ = true;
+        locked_ = false;
         // initialize filter
         e2_ = tper;
         t0_ = t;
@@ -42,13 +62,49 @@ public:
             #endif
             }
         }
+        count_++;
+        // gear shifting
+        if (shifting_){
+            double n = count_;
+            double b = 2.0 * (2.0 * n + 1.0) / ((n + 1.0) * (n + 2.0));
+            double c = 6.0 / ((n + 1.0) * (n + 2.0));
+            if (b > bt_){
+                b_ = b;
+                c_ = c;
+            } else {
+                b_ = bt_;
+                c_ = ct_;
+                shifting_ = false;
+            }
+        }
+        // check if the period estimate has converged:
+        // estimate the timing jitter from the loop error and compute the
+        // standard error of the slope of a least squares fit.
+        if (!locked_){
+            double n = count_ + 1;
+            var_ += (e * e - var_) / std::min<double>(n, 1000);
+            double err = std::sqrt(var_ * 12.0 / (n * (n * n - 1.0))) / tper_;
+            if ((count_ >= AOO_DLL_LOCK_MINPERIODS && err < AOO_DLL_LOCK_TOLERANCE)
+                    || !shifting_){
+                locked_ = true;
+            }
+        }
+    }
+    double time() const {
+        return t0_;
     }
     double period() const {
-        return t1_ - t0_;
+        // the filtered period, without the phase correction
+        // (which can be large while the loop is still wide open)
+        return e2_;
     }
     double samplerate() const {
         return nper_ / period();
     }
+    // true as soon as the period estimate has converged
+    bool locked() const {
+        return locked_;
+    }
 private:
     double b_ = 0;
     double c_ = 0;
@@ -56,7 +112,14 @@ private:
     double t1_ = 0;
     double e_ = 0;
     double e2_ = 0;
+    double tper_ = 0;
+    double bt_ = 0; // target coefficients
+    double ct_ = 0;
+    double var_ = 0;
+    int64_t count_ = 0;
     int nper_ = 0;
+    bool shifting_ = false;
+    bool locked_ = false;
 };
 
 } // aoo
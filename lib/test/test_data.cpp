@@ -0,0 +1,162 @@
+// regression tests for malformed /data messages.
+// build (from this directory) and run with a memory checker, e.g.:
+// c++ -std=c++14 -fsanitize=address -I../src -I../src/lib test_data.cpp ../src/*.cpp -lopus
+
+#include "aoo/aoo.h"
+#include "aoo/aoo_pcm.h"
+#include "aoo_imp.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static int failed = 0;
+
+#define CHECK(x) \
+    if (!(x)){ \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+        failed++; \
+    }
+
+static void noreply(void *, const char *, int32_t){}
+
+static void process(void *, const aoo_sample **, int32_t,
+                    const aoo_event *, int32_t){}
+
+static char payload[1024];
+
+// /AoO/2/data with the given block layout; the blob size field can be overridden.
+static std::vector<char> make_data(int32_t seq, int32_t totalsize, int32_t nframes,
+                                   int32_t framenum, int32_t size, int32_t blobsize)
+{
+    char buf[2048];
+    auto n = aoo::data_message::write(buf, sizeof(buf), "/AoO/2/data", 11,
+                                      1, 7, seq, 0ull, 44100.0, 0,
+                                      totalsize, nframes, framenum,
+                                      aoo::osc::blob(payload, size));
+    // the blob is the last argument
+    aoo::to_bytes<int32_t>(blobsize, buf + n - 4 - aoo::osc::detail::roundup(size));
+    return std::vector<char>(buf, buf + n); // exact size
+}
+
+static std::vector<char> make_binary_data(int32_t seq, int32_t totalsize, int32_t nframes,
+                                          int32_t framenum, int32_t size)
+{
+    aoo::data_packet d;
+    d.sequence = seq;
+    d.time = 0;
+    d.samplerate = 44100;
+    d.channel = 0;
+    d.totalsize = totalsize;
+    d.nframes = nframes;
+    d.framenum = framenum;
+    d.data = payload;
+    d.size = size;
+    char buf[2048];
+    auto n = aoo::write_binary_data(buf, sizeof(buf), 2, 1, 7, d);
+    return std::vector<char>(buf, buf + n); // exact size
+}
+
+static void test_blob_size(){
+    int32_t id, salt, seq, chn, totalsize, nframes, framenum;
+    aoo::osc::timetag time;
+    double sr;
+    aoo::osc::blob b;
+    // valid message
+    auto msg = make_data(0, 8, 1, 0, 8, 8);
+    CHECK(aoo::data_message::read(msg.data(), msg.size(), id, salt, seq, time, sr,
+                                  chn, totalsize, nframes, framenum, b));
+    CHECK(b.size == 8);
+    // the blob size would overflow when rounded up to a multiple of 4
+    msg = make_data(0, 8, 1, 0, 64, 0x7ffffffd);
+    CHECK(!aoo::data_message::read(msg.data(), msg.size(), id, salt, seq, time, sr,
+                                   chn, totalsize, nframes, framenum, b));
+    // the blob size exceeds the message
+    msg = make_data(0, 8, 1, 0, 64, 68);
+    CHECK(!aoo::data_message::read(msg.data(), msg.size(), id, salt, seq, time, sr,
+                                   chn, totalsize, nframes, framenum, b));
+    msg = make_data(0, 8, 1, 0, 64, -4);
+    CHECK(!aoo::data_message::read(msg.data(), msg.size(), id, salt, seq, time, sr,
+                                   chn, totalsize, nframes, framenum, b));
+}
+
+static void test_check_packet(){
+    aoo::data_packet d;
+    d.data = payload;
+    auto check = [&](int32_t totalsize, int32_t nframes, int32_t framenum, int32_t size){
+        d.totalsize = totalsize;
+        d.nframes = nframes;
+        d.framenum = framenum;
+        d.size = size;
+        return aoo::check_data_packet(d);
+    };
+    CHECK(check(100, 1, 0, 100));
+    CHECK(check(100, 2, 0, 60));
+    CHECK(check(100, 2, 1, 40));
+    CHECK(!check(100, 1, 0, 101)); // frame larger than block
+    CHECK(!check(100, 3, 1, 60)); // second frame exceeds the block
+    CHECK(!check(100, 2, 2, 10)); // frame number out of range
+    CHECK(!check(100, 2, -1, 10));
+    CHECK(!check(100, 0, 0, 10)); // no frames
+    CHECK(!check(100, AOO_MAXNUMFRAMES + 1, 0, 1)); // too many frames
+    CHECK(!check(0, 1, 0, 0)); // empty block
+    CHECK(!check(0x7fffffff, 4, 2, 0x40000000)); // frame offset overflows int32_t
+}
+
+// feed malformed messages to a sink; a memory checker catches out of bounds writes.
+static void test_sink(){
+    auto sink = aoo_sink_new(2);
+    aoo_sink_settings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.processfn = process;
+    settings.samplerate = 44100;
+    settings.blocksize = 64;
+    settings.nchannels = 1;
+    settings.buffersize = 20;
+    aoo_sink_setup(sink, &settings);
+
+    // announce source 1 with salt 7
+    char buf[256];
+    char options[4];
+    aoo::to_bytes<int32_t>(AOO_PCM_FLOAT32, options);
+    auto n = aoo::format_message::write(buf, sizeof(buf), "/AoO/2/format", 13,
+                                        1, 7, 1, 44100, 64, AOO_CODEC_PCM_ID,
+                                        aoo::osc::blob(options, 4));
+    aoo_sink_handlemessage(sink, buf, n, 0, noreply);
+
+    std::vector<std::vector<char>> messages = {
+        make_data(0, 8, 1, 0, 64, 0x7ffffffd),
+        make_data(1, 8, 2, 0, 100, 100),
+        make_data(2, 8, 1, 3, 8, 8),
+        make_binary_data(3, 8, 2, 0, 100),
+        make_binary_data(4, 8, 2, 5, 4),
+        make_binary_data(5, 8, 100, 0, 4),
+        // valid first frame, then a frame for a different block layout
+        make_binary_data(6, 8, 2, 0, 4),
+        make_binary_data(6, 1000, 2, 0, 500),
+        make_data(6, 1000, 4, 3, 100, 100)
+    };
+    for (auto& msg : messages){
+        aoo_sink_handlemessage(sink, msg.data(), msg.size(), 0, noreply);
+    }
+
+    aoo_sink_free(sink);
+}
+
+int main(){
+    aoo_setup();
+
+    test_blob_size();
+    test_check_packet();
+    test_sink();
+
+    aoo_close();
+
+    if (failed){
+        fprintf(stderr, "%d check(s) failed\n", failed);
+        return 1;
+    } else {
+        printf("all tests passed\n");
+        return 0;
+    }
+}
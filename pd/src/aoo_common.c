@@ -2,6 +2,8 @@
 #include "aoo/aoo.h"
 #include "aoo/aoo_pcm.h"
 #include "aoo/aoo_opus.h"
+#include "aoo/aoo_lossless.h"
+#include "aoo/aoo_opus_custom.h"
 
 #include <stdio.h>
 #include <inttypes.h>
@@ -122,24 +124,39 @@ int aoo_parseformat(void *x, aoo_format_storage *f, int argc, t_atom *argv)
         aoo_format_pcm *fmt = (aoo_format_pcm *)f;
         fmt->header.codec = AOO_CODEC_PCM;
 
-        int bitdepth = argc > 3 ? atom_getfloat(argv + 3) : 4;
-        switch (bitdepth){
-        case 2:
-            fmt->bitdepth = AOO_PCM_INT16;
-            break;
-        case 3:
-            fmt->bitdepth = AOO_PCM_INT24;
-            break;
-        case 0: // default
-        case 4:
-            fmt->bitdepth = AOO_PCM_FLOAT32;
-            break;
-        case 8:
-            fmt->bitdepth = AOO_PCM_FLOAT64;
-            break;
-        default:
-            pd_error(x, "%s: bad bitdepth argument %d", classname(x), bitdepth);
-            return 0;
+        if (argc > 3 && argv[3].a_type == A_SYMBOL){
+            // G.711 companding ("ulaw" or "alaw") or half precision float
+            t_symbol *sym = argv[3].a_w.w_symbol;
+            if (sym == gensym("ulaw")){
+                fmt->bitdepth = AOO_PCM_ULAW;
+            } else if (sym == gensym("alaw")){
+                fmt->bitdepth = AOO_PCM_ALAW;
+            } else if (sym == gensym("float16")){
+                fmt->bitdepth = AOO_PCM_FLOAT16;
+            } else {
+                pd_error(x, "%s: bad bitdepth argument '%s'", classname(x), sym->s_name);
+                return 0;
+            }
+        } else {
+            int bitdepth = argc > 3 ? atom_getfloat(argv + 3) : 4;
+            switch (bitdepth){
+            case 2:
+                fmt->bitdepth = AOO_PCM_INT16;
+                break;
+            case 3:
+                fmt->bitdepth = AOO_PCM_INT24;
+                break;
+            case 0: // default
+            case 4:
+                fmt->bitdepth = AOO_PCM_FLOAT32;
+                break;
+            case 8:
+                fmt->bitdepth = AOO_PCM_FLOAT64;
+                break;
+            default:
+                pd_error(x, "%s: bad bitdepth argument %d", classname(x), bitdepth);
+                return 0;
+            }
         }
     } else if (codec == gensym(AOO_CODEC_OPUS)){
         aoo_format_opus *fmt = (aoo_format_opus *)f;
@@ -206,6 +223,62 @@ int aoo_parseformat(void *x, aoo_format_storage *f, int argc, t_atom *argv)
         } else {
             fmt->signal_type = OPUS_AUTO;
         }
+        // in-band FEC (0 or 1)
+        fmt->fec = argc > 6 ? (atom_getfloat(argv + 6) != 0) : 0;
+        // expected packet loss (0-100%)
+        if (argc > 7){
+            int loss = atom_getfloat(argv + 7);
+            if (loss < 0 || loss > 100){
+                pd_error(x, "%s: packet loss value %d out of range", classname(x), loss);
+                return 0;
+            }
+            fmt->packet_loss = loss;
+        } else {
+            fmt->packet_loss = 0;
+        }
+        // DTX (0 or 1)
+        fmt->dtx = argc > 8 ? (atom_getfloat(argv + 8) != 0) : 0;
+    } else if (codec == gensym(AOO_CODEC_LOSSLESS)){
+        aoo_format_lossless *fmt = (aoo_format_lossless *)f;
+        fmt->header.codec = AOO_CODEC_LOSSLESS;
+
+        int bitdepth = argc > 3 ? atom_getfloat(argv + 3) : 3;
+        switch (bitdepth){
+        case 2:
+        case 16:
+            fmt->bitdepth = 16;
+            break;
+        case 0: // default
+        case 3:
+        case 24:
+            fmt->bitdepth = 24;
+            break;
+        default:
+            pd_error(x, "%s: bad bitdepth argument %d", classname(x), bitdepth);
+            return 0;
+        }
+#if AOO_OPUS_CUSTOM
+    } else if (codec == gensym(AOO_CODEC_OPUS_CUSTOM)){
+        aoo_format_opus_custom *fmt = (aoo_format_opus_custom *)f;
+        fmt->header.codec = AOO_CODEC_OPUS_CUSTOM;
+        // bitrate (0 = default)
+        fmt->bitrate = argc > 3 ? atom_getfloat(argv + 3) : 0;
+        if (fmt->bitrate < 0){
+            pd_error(x, "%s: bitrate argument %d out of range", classname(x), fmt->bitrate);
+            return 0;
+        }
+        // complexity (0-10)
+        if (argc > 4){
+            int complexity = atom_getfloat(argv + 4);
+            if (complexity < 0 || complexity > 10){
+                pd_error(x, "%s: complexity value %d out of range", classname(x), complexity);
+                return 0;
+            }
+            fmt->complexity = complexity;
+        } else {
+            fmt->complexity = 10;
+        }
+#endif
     } else {
         pd_error(x, "%s: unknown codec '%s'", classname(x), codec->s_name);
         return 0;
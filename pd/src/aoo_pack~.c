@@ -195,6 +195,7 @@ static void * aoo_pack_new(t_symbol *s, int argc, t_atom *argv)
     x->x_settings.packetsize = AOO_DEFPACKETSIZE;
     x->x_settings.time_filter_bandwidth = AOO_DLL_BW;
     x->x_settings.resend_buffersize = AOO_RESEND_BUFSIZE;
+    x->x_settings.ping_interval = AOO_PING_INTERVAL;
 
     // arg #2: num channels
     int nchannels = atom_getfloatarg(1, argc, argv);
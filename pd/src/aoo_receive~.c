@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg()
+#endif
+
 #include "m_pd.h"
 #include "aoo/aoo.h"
 
@@ -28,6 +32,27 @@ typedef int socklen_t;
 
 #define DEFBUFSIZE 20
 
+// get kernel timestamps for incoming packets (Linux)
+#if defined(SO_TIMESTAMPNS) && !defined(_WIN32)
+#define AOO_RECV_TIMESTAMP 1
+#else
+#define AOO_RECV_TIMESTAMP 0
+#endif
+
+// receive several packets with a single system call (Linux)
+#if defined(MSG_WAITFORONE) && !defined(_WIN32)
+#define AOO_RECV_BATCH 1
+#else
+#define AOO_RECV_BATCH 0
+#endif
+
+#define AOO_RECV_BATCHSIZE 32
+
+// forget clients which haven't sent anything for this many seconds
+#define AOO_CLIENT_TIMEOUT 60.0
+#define AOO_CLIENT_SWEEPINTERVAL 10.0
+#define AOO_CLIENT_TABLESIZE 16 // initial size, must be a power of 2
+
 int socket_close(int socket)
 {
 #ifdef _WIN32
@@ -60,29 +85,63 @@ void socket_error_print(const char *label)
 
 /*////////////////////// socket listener //////////////////*/
 
-// use linked list for persistent memory
+// clients are hashed by their address. sinks keep them as endpoint
+// handles, so they are never freed while the listener exists.
+// when a client expires, all sinks forget its sources; only then
+// it may be recycled for a new peer (with a new generation).
 typedef struct _client {
     int socket;
     struct sockaddr_storage addr;
     int addrlen;
-    struct _client *next;
+    uint32_t hash;
+    int generation; // incremented when recycled
+    double lastseen; // OSC time in seconds (expiry time on the free list)
+    struct _client *next; // hash chain or free list
 } t_client;
 
 typedef struct _aoo_receive t_aoo_receive;
 
+typedef struct _recv_entry {
+    int32_t id;
+    t_aoo_receive *recv;
+} t_recv_entry;
+
+#if AOO_RECV_BATCH
+// storage for a single packet in a batch
+typedef struct _recv_slot {
+    struct sockaddr_storage addr;
+    struct iovec iov;
+#if AOO_RECV_TIMESTAMP
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+#endif
+    char buf[AOO_MAXPACKETSIZE];
+} t_recv_slot;
+#endif
+
 static t_class *socket_listener_class;
 
 typedef struct _socket_listener
 {
     t_pd pd;
     t_symbol *sym;
-    // dependants
-    t_aoo_receive **recv;
+    // dependants (sorted by ID)
+    t_recv_entry *recv;
     int numrecv; // doubles as refcount
     // socket
     int socket;
     int port;
-    t_client *clients;
+    // clients (only accessed by the listener thread)
+    t_client **clients; // hash table
+    int tablesize;
+    int numclients;
+    t_client *freeclients; // expired clients (oldest first)
+    t_client *lastfreeclient;
+    double lastsweep;
+#if AOO_RECV_BATCH
+    // preallocated batch
+    struct mmsghdr *msgvec;
+    t_recv_slot *slots;
+#endif
     // threading
     pthread_t thread;
     pthread_mutex_t mutex;
@@ -95,8 +154,279 @@ static void socket_listener_reply(t_client *x, const char *data, int32_t n)
     sendto(x->socket, data, n, 0, (const struct sockaddr *)&x->addr, x->addrlen);
 }
 
-static void aoo_receive_handle_message(t_aoo_receive *x, int32_t id,
-                                const char * data, int32_t n, void *src, aoo_replyfn fn);
+static void aoo_receive_handle_message(t_aoo_receive *x, const char * data, int32_t n,
+                                       void *src, aoo_replyfn fn, uint64_t t);
+
+static void aoo_receive_remove_client(t_aoo_receive *x, t_client *client);
+
+// binary search for the position of the receiver with the given ID
+static int socket_listener_findrecv(t_socket_listener *x, int32_t id)
+{
+    int lo = 0, hi = x->numrecv;
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        if (x->recv[mid].id < id){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+#if AOO_RECV_TIMESTAMP
+static uint64_t socket_timestamp(const struct timespec *ts)
+{
+    // 1970 epoch -> 1900 epoch (including leap years!)
+    uint64_t seconds = (uint64_t)ts->tv_sec + 2208988800UL;
+    // nanoseconds mapped to the range of uint32_t (2^32 / 1e9)
+    uint32_t frac = (uint32_t)((double)ts->tv_nsec * 4.294967296);
+    return (seconds << 32) | frac;
+}
+#endif
+
+static void socket_listener_dispatch(t_socket_listener *x, const char *data, int32_t n,
+                                     t_client *client, uint64_t t)
+{
+    if (n >= 16 && !memcmp(data, "#bundle", 8)){
+        // OSC bundle: forward each element separately (ignore time tag)
+        const char *it = data + 16, *end = data + n;
+        while ((end - it) >= 4){
+            const unsigned char *b = (const unsigned char *)it;
+            int32_t size = (int32_t)(((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16)
+                                     | ((uint32_t)b[2] << 8) | (uint32_t)b[3]);
+            it += 4;
+            if (size < 0 || size > (end - it)){
+                break; // malformed bundle
+            }
+            socket_listener_dispatch(x, it, size, client, t);
+            it += size;
+        }
+        return;
+    }
+    int32_t id = 0;
+    if (aoo_parsemessage(data, n, &id) != AOO_MSG_NONE){
+        // the caller holds the mutex
+        if (id == AOO_ID_WILDCARD){
+            for (int i = 0; i < x->numrecv; ++i){
+                aoo_receive_handle_message(x->recv[i].recv, data, n,
+                                           client, (aoo_replyfn)socket_listener_reply, t);
+            }
+        } else {
+            int i = socket_listener_findrecv(x, id);
+            if (i < x->numrecv && x->recv[i].id == id){
+                aoo_receive_handle_message(x->recv[i].recv, data, n,
+                                           client, (aoo_replyfn)socket_listener_reply, t);
+            }
+        }
+    } else {
+        // not a valid AoO message
+    }
+}
+
+static uint32_t socket_listener_hash(const struct sockaddr_storage *sa, socklen_t len)
+{
+    // FNV-1a
+    const unsigned char *p = (const unsigned char *)sa;
+    uint32_t h = 2166136261u;
+    for (socklen_t i = 0; i < len; ++i){
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void socket_listener_rehash(t_socket_listener *x, int newsize)
+{
+    t_client **table = (t_client **)getbytes(sizeof(t_client *) * newsize);
+    for (int i = 0; i < x->tablesize; ++i){
+        t_client *c = x->clients[i];
+        while (c){
+            t_client *next = c->next;
+            int index = c->hash & (newsize - 1);
+            c->next = table[index];
+            table[index] = c;
+            c = next;
+        }
+    }
+    freebytes(x->clients, sizeof(t_client *) * x->tablesize);
+    x->clients = table;
+    x->tablesize = newsize;
+}
+
+// only called from the listener thread
+static t_client * socket_listener_getclient(t_socket_listener *x,
+                                            const struct sockaddr_storage *sa, socklen_t len,
+                                            uint64_t t)
+{
+    double now = aoo_osctime_toseconds(t);
+    uint32_t hash = socket_listener_hash(sa, len);
+    // try to find client
+    for (t_client *c = x->clients[hash & (x->tablesize - 1)]; c; c = c->next){
+        if (hash == c->hash && len == c->addrlen &&
+            !memcmp(sa, &c->addr, len)){
+            c->lastseen = now;
+            return c;
+        }
+    }
+    // add client
+    t_client *client = x->freeclients;
+    if (client && (now - client->lastseen) >= AOO_CLIENT_SWEEPINTERVAL){
+        // recycle expired client. the sinks have already forgotten it,
+        // but aoo_receive_tick() might still have pending events, so we
+        // wait a bit, lock and bump the generation.
+        x->freeclients = client->next;
+        if (!x->freeclients){
+            x->lastfreeclient = 0;
+        }
+        pthread_mutex_lock(&x->mutex);
+        memcpy(&client->addr, sa, len);
+        client->addrlen = len;
+        client->generation++;
+        pthread_mutex_unlock(&x->mutex);
+    } else {
+        client = (t_client *)getbytes(sizeof(t_client));
+        client->socket = x->socket;
+        memcpy(&client->addr, sa, len);
+        client->addrlen = len;
+        client->generation = 0;
+    }
+    client->hash = hash;
+    client->lastseen = now;
+    // keep the load factor <= 1
+    if (x->numclients >= x->tablesize){
+        socket_listener_rehash(x, x->tablesize * 2);
+    }
+    int index = hash & (x->tablesize - 1);
+    client->next = x->clients[index];
+    x->clients[index] = client;
+    x->numclients++;
+    return client;
+}
+
+// remove idle clients, so that the table doesn't grow forever
+// as peers come and go (e.g. NAT rebinding or reconnects).
+static void socket_listener_sweep(t_socket_listener *x, uint64_t t)
+{
+    double now = aoo_osctime_toseconds(t);
+    if ((now - x->lastsweep) < AOO_CLIENT_SWEEPINTERVAL){
+        return;
+    }
+    x->lastsweep = now;
+    for (int i = 0; i < x->tablesize; ++i){
+        t_client **c = &x->clients[i];
+        while (*c){
+            if ((now - (*c)->lastseen) > AOO_CLIENT_TIMEOUT){
+                t_client *expired = *c;
+                *c = expired->next;
+                x->numclients--;
+                // make all receivers forget the sources of this client
+                pthread_mutex_lock(&x->mutex);
+                for (int j = 0; j < x->numrecv; ++j){
+                    aoo_receive_remove_client(x->recv[j].recv, expired);
+                }
+                pthread_mutex_unlock(&x->mutex);
+                // append to free list
+                expired->lastseen = now;
+                expired->next = 0;
+                if (x->lastfreeclient){
+                    x->lastfreeclient->next = expired;
+                } else {
+                    x->freeclients = expired;
+                }
+                x->lastfreeclient = expired;
+            } else {
+                c = &(*c)->next;
+            }
+        }
+    }
+}
+
+#if AOO_RECV_TIMESTAMP
+static uint64_t socket_listener_gettime(struct msghdr *mh)
+{
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)){
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS){
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            return socket_timestamp(&ts);
+        }
+    }
+    return 0;
+}
+#endif
+
+#if AOO_RECV_BATCH
+
+// drain the socket with recvmmsg() and dispatch the whole batch
+// with a single lock, so that many sources on the same port don't
+// cost a system call and a lock per packet.
+static void* socket_listener_threadfn(void *y)
+{
+    t_socket_listener *x = (t_socket_listener *)y;
+
+    while (!x->quit){
+        for (int i = 0; i < AOO_RECV_BATCHSIZE; ++i){
+            t_recv_slot *slot = &x->slots[i];
+            struct msghdr *mh = &x->msgvec[i].msg_hdr;
+            slot->iov.iov_base = slot->buf;
+            slot->iov.iov_len = AOO_MAXPACKETSIZE;
+            memset(mh, 0, sizeof(*mh));
+            mh->msg_name = &slot->addr;
+            mh->msg_namelen = sizeof(slot->addr);
+            mh->msg_iov = &slot->iov;
+            mh->msg_iovlen = 1;
+        #if AOO_RECV_TIMESTAMP
+            // use the kernel timestamp, so that scheduling
+            // delays in this thread don't show up as network jitter.
+            mh->msg_control = slot->control;
+            mh->msg_controllen = sizeof(slot->control);
+        #endif
+        }
+        // block until the first packet arrives, then take whatever is available
+        int count = recvmmsg(x->socket, x->msgvec, AOO_RECV_BATCHSIZE, MSG_WAITFORONE, 0);
+        if (count > 0){
+            uint64_t now = 0;
+            t_client *clients[AOO_RECV_BATCHSIZE];
+            uint64_t times[AOO_RECV_BATCHSIZE];
+            for (int i = 0; i < count; ++i){
+                struct msghdr *mh = &x->msgvec[i].msg_hdr;
+                uint64_t t = 0; // arrival time
+            #if AOO_RECV_TIMESTAMP
+                t = socket_listener_gettime(mh);
+            #endif
+                if (!t){
+                    // no kernel timestamp, but at least take it before the mutex
+                    if (!now){
+                        now = aoo_osctime_get();
+                    }
+                    t = now;
+                }
+                times[i] = t;
+                clients[i] = socket_listener_getclient(x, &x->slots[i].addr,
+                                                       mh->msg_namelen, t);
+            }
+            socket_listener_sweep(x, times[count - 1]);
+            // forward OSC packets to matching receivers
+            pthread_mutex_lock(&x->mutex);
+            for (int i = 0; i < count; ++i){
+                int nbytes = x->msgvec[i].msg_len;
+                if (nbytes > 0){
+                    socket_listener_dispatch(x, x->slots[i].buf, nbytes, clients[i], times[i]);
+                }
+            }
+            pthread_mutex_unlock(&x->mutex);
+        } else if (count < 0){
+            // ignore errors when quitting
+            if (!x->quit){
+                socket_error_print("recvmmsg");
+            }
+        }
+    }
+
+    return 0;
+}
+
+#else
 
 static void* socket_listener_threadfn(void *y)
 {
@@ -106,43 +436,41 @@ static void* socket_listener_threadfn(void *y)
         struct sockaddr_storage sa;
         socklen_t len = sizeof(sa);
         char buf[AOO_MAXPACKETSIZE];
+        uint64_t t = 0; // arrival time
+    #if AOO_RECV_TIMESTAMP
+        // use recvmsg() to get the kernel timestamp, so that scheduling
+        // delays in this thread don't show up as network jitter.
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = AOO_MAXPACKETSIZE;
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_name = &sa;
+        mh.msg_namelen = len;
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+        int nbytes = recvmsg(x->socket, &mh, 0);
+        if (nbytes > 0){
+            len = mh.msg_namelen;
+            t = socket_listener_gettime(&mh);
+        }
+    #else
         int nbytes = recvfrom(x->socket, buf, AOO_MAXPACKETSIZE, 0, (struct sockaddr *)&sa, &len);
+    #endif
         if (nbytes > 0){
-            // try to find client
-            t_client *client = 0;
-            for (t_client *c = x->clients; c; c = c->next){
-                if (len == c->addrlen &&
-                    !memcmp(&sa, &c->addr, len)){
-                    client = c;
-                    break;
-                }
-            }
-            if (!client){
-                // add client
-                client = (t_client *)getbytes(sizeof(t_client));
-                client->socket = x->socket;
-                memcpy(&client->addr, &sa, len);
-                client->addrlen = len;
-                client->next = 0;
-                if (x->clients){
-                    client->next = x->clients;
-                    x->clients = client;
-                } else {
-                    x->clients = client;
-                }
+            if (!t){
+                // no kernel timestamp, but at least take it before the mutex
+                t = aoo_osctime_get();
             }
+            t_client *client = socket_listener_getclient(x, &sa, len, t);
+            socket_listener_sweep(x, t);
             // forward OSC packet to matching receivers
-            int32_t id = 0;
-            if (aoo_parsepattern(buf, nbytes, &id) > 0){
-                pthread_mutex_lock(&x->mutex);
-                for (int i = 0; i < x->numrecv; ++i){
-                    aoo_receive_handle_message(x->recv[i], id, buf, nbytes,
-                                               client, (aoo_replyfn)socket_listener_reply);
-                }
-                pthread_mutex_unlock(&x->mutex);
-            } else {
-                // not a valid AoO OSC message
-            }
+            pthread_mutex_lock(&x->mutex);
+            socket_listener_dispatch(x, buf, nbytes, client, t);
+            pthread_mutex_unlock(&x->mutex);
         } else if (nbytes < 0){
             // ignore errors when quitting
             if (!x->quit){
@@ -154,8 +482,12 @@ static void* socket_listener_threadfn(void *y)
     return 0;
 }
 
+#endif
+
 static int aoo_receive_match(t_aoo_receive *x, t_aoo_receive *other);
 
+static int32_t aoo_receive_getid(t_aoo_receive *x);
+
 t_socket_listener* socket_listener_add(t_aoo_receive *r, int port)
 {
     // make bind symbol for port number
@@ -163,20 +495,22 @@ t_socket_listener* socket_listener_add(t_aoo_receive *r, int port)
     snprintf(buf, sizeof(buf), "aoo listener %d", port);
     t_symbol *s = gensym(buf);
     t_socket_listener *x = (t_socket_listener *)pd_findbyclass(s, socket_listener_class);
+    int32_t id = aoo_receive_getid(r);
     if (x){
-        // check receiver and add to list
+        // check receiver and insert into list
         pthread_mutex_lock(&x->mutex);
-    #if 1
-        for (int i = 0; i < x->numrecv; ++i){
-            if (aoo_receive_match(x->recv[i], r)){
-                pthread_mutex_unlock(&x->mutex);
-                return 0;
-            }
+        int index = socket_listener_findrecv(x, id);
+        if (index < x->numrecv && x->recv[index].id == id){
+            aoo_receive_match(x->recv[index].recv, r); // post error
+            pthread_mutex_unlock(&x->mutex);
+            return 0;
         }
-    #endif
-        x->recv = (t_aoo_receive **)resizebytes(x->recv, sizeof(t_aoo_receive *) * x->numrecv,
-                                                sizeof(t_aoo_receive *) * (x->numrecv + 1));
-        x->recv[x->numrecv] = r;
+        int n = x->numrecv;
+        x->recv = (t_recv_entry *)resizebytes(x->recv, sizeof(t_recv_entry) * n,
+                                              sizeof(t_recv_entry) * (n + 1));
+        memmove(&x->recv[index + 1], &x->recv[index], sizeof(t_recv_entry) * (n - index));
+        x->recv[index].id = id;
+        x->recv[index].recv = r;
         x->numrecv++;
         pthread_mutex_unlock(&x->mutex);
     } else {
@@ -198,6 +532,13 @@ t_socket_listener* socket_listener_add(t_aoo_receive *r, int port)
             socket_close(sock);
             return 0;
         }
+    #if AOO_RECV_TIMESTAMP
+        // enable kernel timestamps
+        int on = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0){
+            socket_error_print("setsockopt (SO_TIMESTAMPNS)");
+        }
+    #endif
 
         // now create socket listener instance
         x = (t_socket_listener *)getbytes(sizeof(t_socket_listener));
@@ -206,13 +547,23 @@ t_socket_listener* socket_listener_add(t_aoo_receive *r, int port)
         pd_bind(&x->pd, s);
 
         // add receiver
-        x->recv = (t_aoo_receive **)getbytes(sizeof(t_aoo_receive *));
-        x->recv[0] = r;
+        x->recv = (t_recv_entry *)getbytes(sizeof(t_recv_entry));
+        x->recv[0].id = id;
+        x->recv[0].recv = r;
         x->numrecv = 1;
 
         x->socket = sock;
         x->port = port;
-        x->clients = 0;
+        x->clients = (t_client **)getbytes(sizeof(t_client *) * AOO_CLIENT_TABLESIZE);
+        x->tablesize = AOO_CLIENT_TABLESIZE;
+        x->numclients = 0;
+        x->freeclients = 0;
+        x->lastfreeclient = 0;
+        x->lastsweep = 0;
+    #if AOO_RECV_BATCH
+        x->msgvec = (struct mmsghdr *)getbytes(sizeof(struct mmsghdr) * AOO_RECV_BATCHSIZE);
+        x->slots = (t_recv_slot *)getbytes(sizeof(t_recv_slot) * AOO_RECV_BATCHSIZE);
+    #endif
 
         // start thread
         x->quit = 0;
@@ -228,16 +579,18 @@ void socket_listener_release(t_socket_listener *x, t_aoo_receive *r)
 {
     if (x->numrecv > 1){
         // just remove receiver from list
+        pthread_mutex_lock(&x->mutex);
         int n = x->numrecv;
-        for (int i = 0; i < n; ++i){
-            if (x->recv[i] == r){
-                memmove(&x->recv[i], x->recv[i + 1], n - (i + 1));
-                x->recv = (t_aoo_receive **)resizebytes(x->recv, n * sizeof(t_aoo_receive *),
-                                                        (n - 1) * sizeof(t_aoo_receive *));
-                x->numrecv--;
-                return;
-            }
+        int i = socket_listener_findrecv(x, aoo_receive_getid(r));
+        if (i < n && x->recv[i].recv == r){
+            memmove(&x->recv[i], &x->recv[i + 1], sizeof(t_recv_entry) * (n - (i + 1)));
+            x->recv = (t_recv_entry *)resizebytes(x->recv, n * sizeof(t_recv_entry),
+                                                  (n - 1) * sizeof(t_recv_entry));
+            x->numrecv--;
+            pthread_mutex_unlock(&x->mutex);
+            return;
         }
+        pthread_mutex_unlock(&x->mutex);
         bug("socket_listener_release: receiver not found!");
     } else if (x->numrecv == 1){
         // last instance
@@ -277,13 +630,26 @@ void socket_listener_release(t_socket_listener *x, t_aoo_receive *r)
         }
 
         // free memory
-        t_client *c = x->clients;
+        for (int i = 0; i < x->tablesize; ++i){
+            t_client *c = x->clients[i];
+            while (c){
+                t_client *next = c->next;
+                freebytes(c, sizeof(t_client));
+                c = next;
+            }
+        }
+        freebytes(x->clients, sizeof(t_client *) * x->tablesize);
+        t_client *c = x->freeclients;
         while (c){
             t_client *next = c->next;
             freebytes(c, sizeof(t_client));
             c = next;
         }
-        freebytes(x->recv, sizeof(t_aoo_receive*) * x->numrecv);
+        freebytes(x->recv, sizeof(t_recv_entry) * x->numrecv);
+    #if AOO_RECV_BATCH
+        freebytes(x->msgvec, sizeof(struct mmsghdr) * AOO_RECV_BATCHSIZE);
+        freebytes(x->slots, sizeof(t_recv_slot) * AOO_RECV_BATCHSIZE);
+    #endif
         verbose(0, "released socket listener on port %d", x->port);
         freebytes(x, sizeof(*x));
     } else {
@@ -313,6 +679,7 @@ typedef struct _aoo_receive
     pthread_mutex_t x_mutex;
     t_outlet *x_eventout;
     aoo_event *x_eventbuf;
+    int *x_eventgen; // client generation for each event
     int x_eventbufsize;
     int x_numevents;
     t_clock *x_clock;
@@ -333,19 +700,41 @@ static int aoo_receive_match(t_aoo_receive *x, t_aoo_receive *other)
     return 0;
 }
 
-static void aoo_receive_handle_message(t_aoo_receive *x, int32_t id,
-                                const char * data, int32_t n, void *src, aoo_replyfn fn)
+static int32_t aoo_receive_getid(t_aoo_receive *x)
+{
+    return x->x_id;
+}
+
+// called from socket listener (only for matching IDs)
+static void aoo_receive_handle_message(t_aoo_receive *x, const char * data, int32_t n,
+                                       void *src, aoo_replyfn fn, uint64_t t)
+{
+    pthread_mutex_lock(&x->x_mutex);
+    aoo_sink_handlemessage_timed(x->x_aoo_sink, data, n, src, fn, t);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+// called from socket listener when a client has expired
+static void aoo_receive_remove_client(t_aoo_receive *x, t_client *client)
+{
+    pthread_mutex_lock(&x->x_mutex);
+    aoo_sink_removesource(x->x_aoo_sink, client, AOO_ID_WILDCARD);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+static void aoo_receive_buffersize(t_aoo_receive *x, t_floatarg f)
 {
-    if (id == AOO_ID_WILDCARD || id == x->x_id){
+    x->x_settings.buffersize = f;
+    if (x->x_settings.blocksize){
         pthread_mutex_lock(&x->x_mutex);
-        aoo_sink_handlemessage(x->x_aoo_sink, data, n, src, fn);
+        aoo_sink_setup(x->x_aoo_sink, &x->x_settings);
         pthread_mutex_unlock(&x->x_mutex);
     }
 }
 
-static void aoo_receive_buffersize(t_aoo_receive *x, t_floatarg f)
+static void aoo_receive_delay(t_aoo_receive *x, t_floatarg f)
 {
-    x->x_settings.buffersize = f;
+    x->x_settings.playout_delay = f;
     if (x->x_settings.blocksize){
         pthread_mutex_lock(&x->x_mutex);
         aoo_sink_setup(x->x_aoo_sink, &x->x_settings);
@@ -406,11 +795,27 @@ static void aoo_receive_tick(t_aoo_receive *x)
             aoo_source_state_event *e = &x->x_eventbuf[i].source_state;
 
             t_client *client = (t_client *)e->endpoint;
-            struct sockaddr_in *addr = (struct sockaddr_in *)&client->addr;
+            struct sockaddr_in addr;
+            int valid = 1;
+            // the listener might have recycled the client for another peer
+            if (x->x_listener){
+                pthread_mutex_lock(&x->x_listener->mutex);
+            }
+            if (client->generation == x->x_eventgen[i]){
+                memcpy(&addr, &client->addr, sizeof(addr));
+            } else {
+                valid = 0;
+            }
+            if (x->x_listener){
+                pthread_mutex_unlock(&x->x_listener->mutex);
+            }
+            if (!valid){
+                continue;
+            }
 
             t_atom msg[4];
-            const char *host = inet_ntoa(addr->sin_addr);
-            int port = ntohs(addr->sin_port);
+            const char *host = inet_ntoa(addr.sin_addr);
+            int port = ntohs(addr.sin_port);
             if (!host){
                 fprintf(stderr, "inet_ntoa failed!\n");
                 continue;
@@ -439,11 +844,19 @@ static void aoo_receive_process(t_aoo_receive *x, const aoo_sample **data, int32
         if (nevents > x->x_eventbufsize){
             x->x_eventbuf = (aoo_event *)resizebytes(x->x_eventbuf,
                 sizeof(aoo_event) * x->x_eventbufsize, sizeof(aoo_event) * nevents);
+            x->x_eventgen = (int *)resizebytes(x->x_eventgen,
+                sizeof(int) * x->x_eventbufsize, sizeof(int) * nevents);
             x->x_eventbufsize = nevents;
         }
         // copy events
         for (int i = 0; i < nevents; ++i){
             x->x_eventbuf[i] = events[i];
+            if (events[i].type == AOO_SOURCE_STATE_EVENT){
+                // the client can't be recycled yet, because it is
+                // still known to the sink (or has only just expired).
+                t_client *client = (t_client *)events[i].source_state.endpoint;
+                x->x_eventgen[i] = client->generation;
+            }
         }
         x->x_numevents = nevents;
 
@@ -494,6 +907,7 @@ static void * aoo_receive_new(t_symbol *s, int argc, t_atom *argv)
     pthread_mutex_init(&x->x_mutex, 0);
     // pre-allocate event buffer
     x->x_eventbuf = getbytes(sizeof(aoo_event) * 16);
+    x->x_eventgen = getbytes(sizeof(int) * 16);
     x->x_eventbufsize = 16;
     x->x_numevents = 0;
     x->x_clock = clock_new(x, (t_method)aoo_receive_tick);
@@ -505,6 +919,7 @@ static void * aoo_receive_new(t_symbol *s, int argc, t_atom *argv)
     x->x_settings.resend_interval = AOO_RESEND_INTERVAL;
     x->x_settings.resend_maxnumframes = AOO_RESEND_MAXNUMFRAMES;
     x->x_settings.resend_packetsize = AOO_RESEND_PACKETSIZE;
+    x->x_settings.ping_interval = AOO_PING_INTERVAL;
 
     // arg #1: ID
     int id = atom_getfloatarg(0, argc, argv);
@@ -546,6 +961,7 @@ static void aoo_receive_free(t_aoo_receive *x)
     // clean up
     freebytes(x->x_vec, sizeof(t_sample *) * x->x_settings.nchannels);
     freebytes(x->x_eventbuf, sizeof(aoo_event) * x->x_eventbufsize);
+    freebytes(x->x_eventgen, sizeof(int) * x->x_eventbufsize);
     clock_free(x->x_clock);
 
     aoo_sink_free(x->x_aoo_sink);
@@ -563,6 +979,8 @@ void aoo_receive_tilde_setup(void)
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_listen, gensym("listen"), A_FLOAT, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_buffersize,
                     gensym("bufsize"), A_FLOAT, A_NULL);
+    class_addmethod(aoo_receive_class, (t_method)aoo_receive_delay,
+                    gensym("delay"), A_FLOAT, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_timefilter,
                     gensym("timefilter"), A_FLOAT, A_NULL);
     class_addmethod(aoo_receive_class, (t_method)aoo_receive_resend,
@@ -114,6 +114,26 @@ static void aoo_send_resend(t_aoo_send *x, t_floatarg f)
     }
 }
 
+static void aoo_send_bundle(t_aoo_send *x, t_floatarg f)
+{
+    x->x_settings.bundle = f != 0;
+    if (x->x_settings.blocksize){
+        pthread_mutex_lock(&x->x_mutex);
+        aoo_source_setup(x->x_aoo_source, &x->x_settings);
+        pthread_mutex_unlock(&x->x_mutex);
+    }
+}
+
+static void aoo_send_binary(t_aoo_send *x, t_floatarg f)
+{
+    x->x_settings.binary = f != 0;
+    if (x->x_settings.blocksize){
+        pthread_mutex_lock(&x->x_mutex);
+        aoo_source_setup(x->x_aoo_source, &x->x_settings);
+        pthread_mutex_unlock(&x->x_mutex);
+    }
+}
+
 static void aoo_send_timefilter(t_aoo_send *x, t_floatarg f)
 {
     x->x_settings.time_filter_bandwidth = f;
@@ -310,6 +330,7 @@ static void * aoo_send_new(t_symbol *s, int argc, t_atom *argv)
     x->x_settings.packetsize = AOO_DEFPACKETSIZE;
     x->x_settings.time_filter_bandwidth = AOO_DLL_BW;
     x->x_settings.resend_buffersize = AOO_RESEND_BUFSIZE;
+    x->x_settings.ping_interval = AOO_PING_INTERVAL;
 
     // arg #2: num channels
     int nchannels = atom_getfloatarg(1, argc, argv);
@@ -390,6 +411,8 @@ void aoo_send_tilde_setup(void)
     class_addmethod(aoo_send_class, (t_method)aoo_send_packetsize, gensym("packetsize"), A_FLOAT, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_resend, gensym("resend"), A_FLOAT, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_clear, gensym("clear"), A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_bundle, gensym("bundle"), A_FLOAT, A_NULL);
+    class_addmethod(aoo_send_class, (t_method)aoo_send_binary, gensym("binary"), A_FLOAT, A_NULL);
     class_addmethod(aoo_send_class, (t_method)aoo_send_timefilter, gensym("timefilter"), A_FLOAT, A_NULL);
 
     aoo_setup();
@@ -62,6 +62,14 @@ static void aoo_unpack_buffersize(t_aoo_unpack *x, t_floatarg f)
     }
 }
 
+static void aoo_unpack_delay(t_aoo_unpack *x, t_floatarg f)
+{
+    x->x_settings.playout_delay = f;
+    if (x->x_settings.blocksize){
+        aoo_sink_setup(x->x_aoo_sink, &x->x_settings);
+    }
+}
+
 static void aoo_unpack_timefilter(t_aoo_unpack *x, t_floatarg f)
 {
     x->x_settings.time_filter_bandwidth = f;
@@ -168,6 +176,7 @@ static void * aoo_unpack_new(t_symbol *s, int argc, t_atom *argv)
     x->x_settings.resend_interval = AOO_RESEND_INTERVAL;
     x->x_settings.resend_maxnumframes = AOO_RESEND_MAXNUMFRAMES;
     x->x_settings.resend_packetsize = AOO_RESEND_PACKETSIZE;
+    x->x_settings.ping_interval = AOO_PING_INTERVAL;
 
     // arg #1: ID
     int id = atom_getfloatarg(0, argc, argv);
@@ -213,6 +222,8 @@ void aoo_unpack_tilde_setup(void)
     class_addlist(aoo_unpack_class, (t_method)aoo_unpack_list);
     class_addmethod(aoo_unpack_class, (t_method)aoo_unpack_buffersize,
                     gensym("bufsize"), A_FLOAT, A_NULL);
+    class_addmethod(aoo_unpack_class, (t_method)aoo_unpack_delay,
+                    gensym("delay"), A_FLOAT, A_NULL);
     class_addmethod(aoo_unpack_class, (t_method)aoo_unpack_timefilter,
                     gensym("timefilter"), A_FLOAT, A_NULL);
     class_addmethod(aoo_unpack_class, (t_method)aoo_unpack_resend,